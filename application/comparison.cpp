@@ -0,0 +1,226 @@
+// Copyright Lebedev Alexander 2020
+#include "comparison.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    const QColor colors[] = {
+        QColor(31, 119, 180),
+        QColor(255, 127, 14),
+        QColor(44, 160, 44)
+    };
+
+    // Rows of the trial strips, one per method, below the curve
+    constexpr double firstRow = -9.;
+    constexpr double rowStep  = 1.2;
+}
+
+Comparison::Comparison(QCustomPlot *plot,
+                       Objective objective,
+                       uint32_t count,
+                       double eps,
+                       double parameter)
+        : m_plot(plot),
+          m_objective(objective),
+          m_done(false)
+{
+    m_rect = new QCPAxisRect(m_plot);
+    m_plot->plotLayout()->addElement(1, 0, m_rect);
+    m_plot->plotLayout()->setRowStretchFactor(1, 0.5);
+    m_rect->axis(QCPAxis::atBottom)->setLabel("Evaluations");
+    m_rect->axis(QCPAxis::atLeft)->setLabel("Best value");
+
+    m_curve = m_plot->addGraph();
+    m_curve->setPen(QPen(Qt::black));
+
+    m_lanes.push_back(std::make_unique<Lane>("Strongin"));
+    m_lanes.back()->method = std::make_unique<StronginMethod>(count, eps, parameter, objective.function);
+    m_lanes.push_back(std::make_unique<Lane>("Piyavskiy"));
+    m_lanes.back()->method = std::make_unique<PiyavskiyMethod>(count, eps, parameter, objective.function);
+    m_lanes.push_back(std::make_unique<Lane>("SeqScanning"));
+    m_lanes.back()->method = std::make_unique<SeqScanMethod>(count, eps, objective.function);
+
+    for (size_t i = 0; i < m_lanes.size(); i++)
+    {
+        auto &lane = *m_lanes[i];
+        lane.trials = std::make_unique<TrialLod>(m_plot, firstRow + rowStep * i);
+        lane.trials->setColor(colors[i]);
+        lane.convergence = m_plot->addGraph(m_rect->axis(QCPAxis::atBottom), m_rect->axis(QCPAxis::atLeft));
+        lane.convergence->setPen(QPen(colors[i]));
+        lane.convergence->setLineStyle(QCPGraph::lsStepLeft);
+        lane.evaluations = 0;
+        lane.best = std::numeric_limits<double>::max();
+        lane.count = 0;
+        lane.min = 0.;
+        lane.point = 0.;
+
+        lane.method->setObserver(&lane.stream, 0);
+        lane.method->setCancellationToken(&m_token);
+        lane.stream.setCancellationToken(&m_token);
+    }
+}
+
+Comparison::~Comparison()
+{
+    m_token.cancel();
+
+    for (auto &lane : m_lanes)
+    {
+        if (lane->worker.joinable())
+        {
+            lane->worker.join();
+        }
+        m_plot->removeGraph(lane->convergence);
+        lane->trials.reset();
+    }
+
+    m_plot->removeGraph(m_curve);
+    m_plot->plotLayout()->remove(m_rect);
+    m_plot->plotLayout()->simplify();
+}
+
+void Comparison::start(double x1, double x2)
+{
+    for (auto &lane : m_lanes)
+    {
+        lane->worker = std::thread([run = lane.get(), x1, x2] {
+            run->method->execute(&run->count, &run->min, &run->point, x1, x2);
+            run->finished = true;
+        });
+    }
+}
+
+void Comparison::stop()
+{
+    m_token.cancel();
+}
+
+bool Comparison::refresh()
+{
+    if (m_done)
+    {
+        return true;
+    }
+
+    bool done = true;
+    bool changed = false;
+
+    for (auto &lane : m_lanes)
+    {
+        // Read the flag before draining so no trial pushed before it is missed
+        bool finished = lane->finished;
+
+        // Trials arrive in evaluation order, which is what the convergence curve needs
+        std::vector<Trial> batch;
+        QVector<double> keys;
+        QVector<double> values;
+        lane->queue.drain([&] (const Trial &trial) {
+            batch.push_back(trial);
+            lane->evaluations++;
+            if (trial.z < lane->best)
+            {
+                lane->best = trial.z;
+                keys.push_back(lane->evaluations);
+                values.push_back(lane->best);
+            }
+        });
+
+        if (!batch.empty())
+        {
+            std::vector<double> x(batch.size());
+            for (size_t i = 0; i < batch.size(); i++)
+            {
+                x[i] = batch[i].x;
+            }
+            std::sort(x.begin(), x.end());
+
+            lane->trials->add(x);
+            lane->trials->update();
+            changed = true;
+        }
+
+        // Extend the step curve to the latest evaluation count
+        if (!batch.empty())
+        {
+            keys.push_back(lane->evaluations);
+            values.push_back(lane->best);
+            lane->convergence->addData(keys, values, true);
+        }
+
+        if (finished && lane->worker.joinable())
+        {
+            lane->worker.join();
+        }
+        done = done && finished;
+    }
+
+    if (changed)
+    {
+        m_rect->axis(QCPAxis::atBottom)->rescale();
+        m_rect->axis(QCPAxis::atLeft)->rescale();
+    }
+
+    m_done = done;
+    return done;
+}
+
+void Comparison::update()
+{
+    for (auto &lane : m_lanes)
+    {
+        lane->trials->update();
+    }
+}
+
+QCPGraph *Comparison::curve() const noexcept
+{
+    return m_curve;
+}
+
+const Objective &Comparison::objective() const noexcept
+{
+    return m_objective;
+}
+
+std::vector<TrialView> Comparison::getTrials() const
+{
+    std::vector<TrialView> trials;
+    if (m_done)
+    {
+        for (auto &lane : m_lanes)
+        {
+            trials.push_back(lane->method->getTrials());
+        }
+    }
+    return trials;
+}
+
+void Comparison::getResult(uint32_t *count, double *min, double *point) const
+{
+    const Lane *best = nullptr;
+    for (auto &lane : m_lanes)
+    {
+        auto state = lane->method->getState();
+        if (!best || state.min < best->method->getState().min)
+        {
+            best = lane.get();
+        }
+    }
+
+    auto state = best->method->getState();
+    *count = state.iteration;
+    *min = state.min;
+    *point = state.point;
+}
+
+QString Comparison::describe() const
+{
+    QStringList names;
+    for (size_t i = 0; i < m_lanes.size(); i++)
+    {
+        names << QString("<font color=\"%1\">%2</font>").arg(colors[i].name(), m_lanes[i]->name);
+    }
+    return names.join(", ");
+}
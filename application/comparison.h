@@ -0,0 +1,78 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+#include "3rdparty/qcustomplot.h"
+#include "triallod.h"
+#include "trialqueue.h"
+
+#include <method.hpp>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Runs every method on its own thread over the same objective. Trials of each
+// method are drawn on their own row and the best value against the number of
+// evaluations is plotted in a second axis rect below the main one.
+class Comparison
+{
+public:
+    Comparison(QCustomPlot *plot,
+               Objective objective,
+               uint32_t count,
+               double eps,
+               double parameter);
+
+    ~Comparison();
+
+    void start(double x1, double x2);
+
+    void stop();
+
+    // Drains the trial queues, returns true once every method has finished
+    bool refresh();
+
+    // Rebuilds the trial rows for the current key axis range
+    void update();
+
+    [[nodiscard]] QCPGraph *curve() const noexcept;
+
+    [[nodiscard]] const Objective &objective() const noexcept;
+
+    // Trials of the finished searches, empty while any of them is running
+    [[nodiscard]] std::vector<TrialView> getTrials() const;
+
+    // Best result among the methods
+    void getResult(uint32_t *count, double *min, double *point) const;
+
+    [[nodiscard]] QString describe() const;
+
+private:
+    struct Lane
+    {
+        explicit Lane(QString laneName) : name(laneName), finished(false), stream(queue) { }
+
+        QString                   name;
+        std::unique_ptr<IMethod>  method;
+        std::thread               worker;
+        std::atomic<bool>         finished;
+        TrialQueue                queue;
+        TrialStream               stream;
+        std::unique_ptr<TrialLod> trials;
+        QCPGraph                 *convergence;
+        uint32_t                  evaluations;
+        double                    best;
+        uint32_t                  count;
+        double                    min;
+        double                    point;
+    };
+
+    QCustomPlot                       *m_plot;
+    QCPAxisRect                       *m_rect;
+    QCPGraph                          *m_curve;
+    Objective                          m_objective;
+    CancellationToken                  m_token;
+    std::vector<std::unique_ptr<Lane>> m_lanes;
+    bool                               m_done;
+};
@@ -1,22 +1,42 @@
 // Copyright Lebedev Alexander 2020
 #include "mainwindow.h"
 
+#include <expression.hpp>
 #include <method.hpp>
+#include <plugin.hpp>
+#include <sampler.hpp>
 
+#include <algorithm>
 #include <iostream>
 #include <functional>
 #include <cmath>
+#include <map>
+#include <string>
+#include <vector>
 
 #include <QVBoxLayout>
 #include <QGridLayout>
 #include <QHBoxLayout>
+#include <QMessageBox>
+
+namespace
+{
+    // Older runs are released, their plottables are reused by new runs
+    constexpr size_t historySize = 5;
+}
  
 Window::Window(QWidget *parent)
         : QWidget(parent),
+          current(nullptr),
+          displayed(nullptr),
+          finished(true),
+          stream(queue),
           methodType(STRONGIN)
 {
 
     // LineEdits
+    formula = new QLineEdit("a*sin(b*x) + c*cos(d*x)", this);
+
     evalA = new QLineEdit("2", this);
     evalB = new QLineEdit("3", this);
     evalC = new QLineEdit("3", this);
@@ -29,6 +49,11 @@ Window::Window(QWidget *parent)
     eps       = new QLineEdit("0.01", this);
     maxCount  = new QLineEdit("800", this);
 
+    lipschitz = new QComboBox(this);
+    lipschitz->addItem("Estimate", static_cast<int>(LipschitzMode::Estimate));
+    lipschitz->addItem("Bound of |F'|", static_cast<int>(LipschitzMode::Bound));
+    lipschitz->addItem("Tighter of both", static_cast<int>(LipschitzMode::Tighter));
+
     min   = new QLineEdit(this);
     count = new QLineEdit(this);
     x     = new QLineEdit(this);
@@ -40,16 +65,17 @@ Window::Window(QWidget *parent)
     // Lables
     QLabel *header      = new QLabel("Search for the global minimum of a function:", this);
     QLabel *evaluation1 = new QLabel("F(x) = ", this);
-    QLabel *evaluation2 = new QLabel("sin", this);
-    QLabel *evaluation3 = new QLabel("x + ", this);
-    QLabel *evaluation4 = new QLabel("cos", this);
-    QLabel *evaluation5 = new QLabel("x", this);
+    QLabel *evaluation2 = new QLabel("a = ", this);
+    QLabel *evaluation3 = new QLabel("b = ", this);
+    QLabel *evaluation4 = new QLabel("c = ", this);
+    QLabel *evaluation5 = new QLabel("d = ", this);
 
     QLabel *boundary = new QLabel(" <= x <= ", this);
 
     QLabel *parameterLabel = new QLabel("Parameter: ", this);
     QLabel *epsLabel       = new QLabel("Accuracy: ", this);
     QLabel *maxCountLabel  = new QLabel("Maximal Count: ", this);
+    QLabel *lipschitzLabel = new QLabel("Lipschitz M: ", this);
 
     methodLabel = new QLabel("Strongin");
 
@@ -60,7 +86,13 @@ Window::Window(QWidget *parent)
     QLabel *countLabel = new QLabel("Count: ", this);
     
     // Buttons
-    QPushButton *runButton = new QPushButton("Run", this);
+    runButton  = new QPushButton("Run", this);
+    stopButton = new QPushButton("Stop", this);
+    stopButton->setEnabled(false);
+    compareButton = new QPushButton("Compare", this);
+
+    runSelector = new QComboBox(this);
+    runSelector->addItem("All runs");
 
     QPushButton *stronginButton    = new QPushButton("Strongin", this);
     QPushButton *PiyavskiyButton = new QPushButton("Piyavskiy", this);
@@ -69,6 +101,7 @@ Window::Window(QWidget *parent)
     // Layouts
     auto mainLayout = new QGridLayout(this);
     auto layout  = new QVBoxLayout();
+    auto formulaLayout = new QHBoxLayout();
     auto evalLayout = new QHBoxLayout();
     auto boundaryLayout = new QHBoxLayout();
     auto methodButtonsLayout = new QHBoxLayout();
@@ -79,15 +112,18 @@ Window::Window(QWidget *parent)
     // Building
     layout->addWidget(header);
 
-    evalLayout->addWidget(evaluation1);
-    evalLayout->addWidget(evalA);
+    formulaLayout->addWidget(evaluation1);
+    formulaLayout->addWidget(formula);
+    layout->addLayout(formulaLayout);
+
     evalLayout->addWidget(evaluation2);
-    evalLayout->addWidget(evalB);
+    evalLayout->addWidget(evalA);
     evalLayout->addWidget(evaluation3);
-    evalLayout->addWidget(evalC);
+    evalLayout->addWidget(evalB);
     evalLayout->addWidget(evaluation4);
-    evalLayout->addWidget(evalD);
+    evalLayout->addWidget(evalC);
     evalLayout->addWidget(evaluation5);
+    evalLayout->addWidget(evalD);
     layout->addLayout(evalLayout);
 
     boundaryLayout->addWidget(x1);
@@ -111,9 +147,16 @@ Window::Window(QWidget *parent)
     parametersLayout->addWidget(eps, 1, 1);
     parametersLayout->addWidget(maxCountLabel, 2, 0);
     parametersLayout->addWidget(maxCount, 2, 1);
+    parametersLayout->addWidget(lipschitzLabel, 3, 0);
+    parametersLayout->addWidget(lipschitz, 3, 1);
     layout->addLayout(parametersLayout);
 
-    layout->addWidget(runButton);
+    auto runLayout = new QHBoxLayout();
+    runLayout->addWidget(runButton);
+    runLayout->addWidget(compareButton);
+    runLayout->addWidget(stopButton);
+    layout->addLayout(runLayout);
+    layout->addWidget(runSelector);
 
     layout->addWidget(new QLabel("Results:", this));
     resultLayout->addWidget(minLabel, 0, 0);
@@ -137,21 +180,46 @@ Window::Window(QWidget *parent)
     connect(customPlot->xAxis, SIGNAL(rangeChanged(QCPRange)), customPlot->xAxis2, SLOT(setRange(QCPRange)));
     connect(customPlot->yAxis, SIGNAL(rangeChanged(QCPRange)), customPlot->yAxis2, SLOT(setRange(QCPRange)));
 
+    customPlot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+    customPlot->axisRect()->setRangeDrag(Qt::Horizontal);
+    customPlot->axisRect()->setRangeZoom(Qt::Horizontal);
+
     QSizePolicy sp = customPlot->sizePolicy();
     sp.setHorizontalStretch(1);
     customPlot->setSizePolicy(sp);
     mainLayout->addWidget(customPlot, 0, 1);
 
+    history = std::make_unique<RunHistory>(customPlot, historySize);
+
     setLayout(mainLayout);
 
+    // Capped at roughly 30 frames per second while a search is running
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(33);
+
     // Connect
     connect(runButton, &QPushButton::clicked, this, &Window::run);
+    connect(stopButton, &QPushButton::clicked, this, &Window::stop);
+    connect(compareButton, &QPushButton::clicked, this, &Window::compare);
+    connect(refreshTimer, &QTimer::timeout, this, &Window::refresh);
+    connect(runSelector, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &Window::selectRun);
+    connect(customPlot->xAxis, QOverload<const QCPRange &>::of(&QCPAxis::rangeChanged), this, &Window::rangeChanged);
     
     connect(stronginButton, &QPushButton::clicked, this, &Window::setStrongin);
     connect(PiyavskiyButton, &QPushButton::clicked, this, &Window::setPiyavskiy);
     connect(scanButton, &QPushButton::clicked, this, &Window::setScan);
 }
 
+Window::~Window()
+{
+    comparison.reset();
+    token.cancel();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
 void Window::setStrongin() noexcept
 {
     methodType = STRONGIN;
@@ -170,12 +238,63 @@ void Window::setScan() noexcept
     methodLabel->setText("Sequential scanning");
 }
 
+Objective Window::makeObjective()
+{
+    std::map<std::string, double> parameters = {
+        {"a", evalA->text().toDouble()},
+        {"b", evalB->text().toDouble()},
+        {"c", evalC->text().toDouble()},
+        {"d", evalD->text().toDouble()}
+    };
+
+    // "plugin:path arguments" loads the objective from a shared library
+    auto text = formula->text().trimmed();
+    if (text.startsWith("plugin:"))
+    {
+        auto spec = text.mid(7).trimmed();
+        auto separator = spec.indexOf(' ');
+        auto path = separator < 0 ? spec : spec.left(separator);
+        auto arguments = separator < 0 ? QString() : spec.mid(separator + 1).trimmed();
+
+        auto plugin = std::make_shared<const PluginObjective>(path.toStdString(), arguments.toStdString());
+        if (!plugin->isLoaded())
+        {
+            QMessageBox::warning(this, "Plugin", QString::fromStdString(plugin->getError()));
+            return Objective();
+        }
+        return ::makeObjective(plugin);
+    }
+
+    // The search runs on worker threads, so the objective owns its bytecode
+    auto expression = std::make_shared<const Expression>(formula->text().toStdString(), parameters);
+    if (!expression->isValid())
+    {
+        QMessageBox::warning(this, "Formula", QString::fromStdString(expression->getError()));
+        return Objective();
+    }
+
+    return {
+        [expression] (double x) {
+            return expression->evaluate(x);
+        },
+        [expression] (const double *x, double *z, size_t count) {
+            expression->evaluate(x, z, count);
+        },
+        [expression] (const Interval &x) {
+            return expression->enclose(x);
+        },
+        [expression] (const Interval &x) {
+            return expression->encloseDerivative(x);
+        }
+    };
+}
+
 void Window::run()
 {
-    auto evalAVal = evalA->text().toDouble();
-    auto evalBVal = evalB->text().toDouble();
-    auto evalCVal = evalC->text().toDouble();
-    auto evalDVal = evalD->text().toDouble();
+    if (refreshTimer->isActive())
+    {
+        return;
+    }
 
     auto x1Val = x1->text().toDouble();
     auto x2Val = x2->text().toDouble();
@@ -184,69 +303,292 @@ void Window::run()
     auto epsVal       = eps->text().toDouble();
     auto maxCountVal  = maxCount->text().toUInt();
 
-    double globalMin     = 0.;
-    double globalPoint   = 0.;
-    uint32_t globalCount = 0;
-
-    customPlot->addGraph();
-    customPlot->graph(0)->setPen(QPen(Qt::blue));
-    QVector<double> cx(500), y(500);
-    double len = static_cast<double>(x2Val - x1Val) / 500;
-
-    for (int i = 0; i < 500; i++)
+    auto objective = makeObjective();
+    if (!objective)
     {
-        cx[i] = i * len;
-        y[i] = evalAVal * sin(cx[i] * evalBVal) + evalCVal * cos(cx[i] * evalDVal);
+        return;
     }
 
-    customPlot->graph(0)->setData(cx, y);
-    customPlot->graph(0)->rescaleAxes();
-    customPlot->xAxis->setRange(x1Val, x2Val);
-    customPlot->yAxis->setRange(-10, 10);
+    comparison.reset();
+    current = &history->start();
 
-    auto lambda = [&] (double x) -> double {
-            return evalAVal * sin(x * evalBVal) + evalCVal * cos(x * evalDVal);
-        };
+    runSelector->blockSignals(true);
+    runSelector->clear();
+    runSelector->addItem("All runs");
+    for (size_t i = 0; i < history->size(); i++)
+    {
+        runSelector->addItem(QString("Run %1").arg(history->at(i).id));
+    }
+    runSelector->setCurrentIndex(history->isOverlaid() ? 0 : static_cast<int>(history->size()));
+    runSelector->blockSignals(false);
 
-    IMethod *method;
+    current->objective = objective;
 
     switch (methodType)
     {
     case SCAN:
-        method = new SeqScanMethod(maxCountVal, epsVal, lambda);
+        current->method = std::make_unique<SeqScanMethod>(maxCountVal, epsVal, current->objective.function);
+        methodLabel->setText("Sequential scanning");
         break;
 
     case PIYAVSKIY:
 
-        method = new PiyavskiyMethod(maxCountVal, epsVal, parameterVal, lambda);
+        current->method = std::make_unique<PiyavskiyMethod>(maxCountVal, epsVal, parameterVal, current->objective.function);
+        methodLabel->setText("Piyavskiy");
         break;
 
     case STRONGIN:
-        method = new StronginMethod(maxCountVal, epsVal, parameterVal, lambda);
+        current->method = std::make_unique<StronginMethod>(maxCountVal, epsVal, parameterVal, current->objective.function);
+        methodLabel->setText("Strongin");
         break;
     }
-    
-    method->execute(&globalCount, &globalMin, &globalPoint, x1Val, x2Val);
-    
-    auto xVector = method->getXVector();
-    QVector<double> qXVector;
-    QVector<double> qYVector;
 
-    for (auto x : xVector)
+    customPlot->xAxis->setRange(x1Val, x2Val);
+    customPlot->yAxis->setRange(-10, 10);
+    sampleCurve(current->curve, current->objective.batch, nullptr);
+    customPlot->replot();
+
+    queue.clear();
+    token.reset();
+    finished = false;
+
+    current->method->setObserver(&stream, 0);
+    current->method->setCancellationToken(&token);
+    stream.setCancellationToken(&token);
+    current->method->setLipschitz(static_cast<LipschitzMode>(lipschitz->currentData().toInt()),
+                                  current->objective.derivative);
+
+    worker = std::thread([run = current, this, x1Val, x2Val] {
+        run->method->execute(&run->count, &run->min, &run->point, x1Val, x2Val);
+        finished = true;
+    });
+
+    runButton->setEnabled(false);
+    compareButton->setEnabled(false);
+    stopButton->setEnabled(true);
+    refreshTimer->start();
+}
+
+void Window::compare()
+{
+    if (refreshTimer->isActive())
+    {
+        return;
+    }
+
+    auto x1Val = x1->text().toDouble();
+    auto x2Val = x2->text().toDouble();
+
+    auto parameterVal = parameter->text().toDouble(); 
+    auto epsVal       = eps->text().toDouble();
+    auto maxCountVal  = maxCount->text().toUInt();
+
+    auto objective = makeObjective();
+    if (!objective)
+    {
+        return;
+    }
+
+    comparison.reset();
+    comparison = std::make_unique<Comparison>(customPlot, objective, maxCountVal, epsVal, parameterVal);
+    history->setVisible(false);
+    methodLabel->setText("Compare: " + comparison->describe());
+
+    customPlot->xAxis->setRange(x1Val, x2Val);
+    customPlot->yAxis->setRange(-10, 10);
+    sampleCurve(comparison->curve(), comparison->objective().batch, nullptr);
+    customPlot->replot();
+
+    comparison->start(x1Val, x2Val);
+
+    runButton->setEnabled(false);
+    compareButton->setEnabled(false);
+    stopButton->setEnabled(true);
+    refreshTimer->start();
+}
+
+void Window::stop()
+{
+    token.cancel();
+
+    if (comparison)
+    {
+        comparison->stop();
+    }
+}
+
+void Window::selectRun(int index)
+{
+    if (comparison)
     {
-        qXVector.push_back(x);
-        qYVector.push_back(-9.);
+        if (refreshTimer->isActive())
+        {
+            return;
+        }
+        comparison.reset();
+        history->setVisible(true);
     }
 
-    customPlot->addGraph();
-    customPlot->graph(1)->setData(qXVector, qYVector);
-    customPlot->graph(1)->setPen(QColor(50, 50, 50, 255));
-    customPlot->graph(1)->setLineStyle(QCPGraph::lsNone);
-    customPlot->graph(1)->setScatterStyle(QCPScatterStyle(QCPScatterStyle::ssCircle, 4));
+    history->show(index - 1);
 
+    auto run = index > 0 ? &history->at(index - 1) : history->latest();
+    if (run && run != displayed)
+    {
+        showResults(run->count, run->min, run->point);
+        displayed = run;
+    }
     customPlot->replot();
+}
+
+void Window::refresh()
+{
+    if (comparison)
+    {
+        bool comparisonDone = comparison->refresh();
+        customPlot->replot(QCustomPlot::rpQueuedReplot);
+
+        uint32_t countVal;
+        double minVal;
+        double pointVal;
+        comparison->getResult(&countVal, &minVal, &pointVal);
+        showResults(countVal, minVal, pointVal);
+        displayed = nullptr;
+
+        if (comparisonDone)
+        {
+            finishComparison();
+        }
+        return;
+    }
+
+    // Read the flag before draining so no trial pushed before it is missed
+    bool done = finished;
+
+    std::vector<Trial> batch;
+    queue.drain([&batch] (const Trial &trial) {
+        batch.push_back(trial);
+    });
+
+    if (!batch.empty())
+    {
+        std::sort(batch.begin(), batch.end(), [] (const Trial &lhs, const Trial &rhs) {
+            return lhs.x < rhs.x;
+        });
+
+        std::vector<double> keys(batch.size());
+        for (size_t i = 0; i < batch.size(); i++)
+        {
+            keys[i] = batch[i].x;
+        }
+
+        current->trials->add(keys);
+        current->trials->update();
+        current->minorant->add(*current->method, batch, current->method->getState().m);
+        customPlot->replot(QCustomPlot::rpQueuedReplot);
+    }
+
+    if (done)
+    {
+        finish();
+        return;
+    }
+
+    auto state = current->method->getState();
+    showResults(state.iteration, state.min, state.point);
+    displayed = current;
+}
 
-    min->setPlaceholderText(QString::number(globalMin));
-    count->setPlaceholderText(QString::number(globalCount));
-    x->setPlaceholderText(QString::number(globalPoint));
+void Window::rangeChanged()
+{
+    if (comparison)
+    {
+        comparison->update();
+
+        auto trials = comparison->getTrials();
+        sampleCurve(comparison->curve(), comparison->objective().batch, trials.empty() ? nullptr : &trials.front());
+        return;
+    }
+
+    if (!history)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < history->size(); i++)
+    {
+        auto &run = history->at(i);
+        if (!history->isShown(run))
+        {
+            continue;
+        }
+
+        run.trials->update();
+
+        // Trials may be read only once the worker is gone
+        bool running = &run == current && worker.joinable();
+        auto trials = run.method && !running ? run.method->getTrials() : TrialView(nullptr, nullptr, 0);
+        sampleCurve(run.curve, run.objective.batch, trials.empty() ? nullptr : &trials);
+    }
+}
+
+void Window::sampleCurve(QCPGraph *graph, const BatchFunction &function, const TrialView *cache)
+{
+    // Half a pixel of deviation from the drawn polyline is invisible
+    auto xRange = customPlot->xAxis->range();
+    auto yRange = customPlot->yAxis->range();
+    double width = std::max(1, customPlot->axisRect()->width());
+    double height = std::max(1, customPlot->axisRect()->height());
+
+    CurveSampler sampler(function);
+    auto curve = sampler.sample(xRange.lower,
+                                xRange.upper,
+                                xRange.size() / width,
+                                0.5 * yRange.size() / height,
+                                cache);
+
+    QVector<QCPGraphData> points(static_cast<int>(curve.size()));
+    for (size_t i = 0; i < curve.size(); i++)
+    {
+        points[static_cast<int>(i)] = QCPGraphData(curve[i].x, curve[i].z);
+    }
+
+    graph->data()->set(points, true);
+}
+
+void Window::finish()
+{
+    refreshTimer->stop();
+    worker.join();
+
+    // Trials of the finished search are free samples for the final curve
+    auto trials = current->method->getTrials();
+    sampleCurve(current->curve, current->objective.batch, &trials);
+    customPlot->replot();
+
+    runButton->setEnabled(true);
+    compareButton->setEnabled(true);
+    stopButton->setEnabled(false);
+
+    showResults(current->count, current->min, current->point);
+    displayed = current;
+}
+
+void Window::finishComparison()
+{
+    refreshTimer->stop();
+
+    auto trials = comparison->getTrials();
+    sampleCurve(comparison->curve(), comparison->objective().batch, trials.empty() ? nullptr : &trials.front());
+    customPlot->replot();
+
+    runButton->setEnabled(true);
+    compareButton->setEnabled(true);
+    stopButton->setEnabled(false);
+}
+
+void Window::showResults(uint32_t countVal, double minVal, double pointVal)
+{
+    min->setPlaceholderText(QString::number(minVal));
+    count->setPlaceholderText(QString::number(countVal));
+    x->setPlaceholderText(QString::number(pointVal));
 }
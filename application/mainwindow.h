@@ -2,19 +2,31 @@
 #pragma once
  
 #include <QWidget>
+#include <QComboBox>
 #include <QTableWidget>
 #include <QPushButton>
 #include <QLineEdit>
 #include <QLabel>
+#include <QTimer>
 
 #include "3rdparty/qcustomplot.h"
+#include "comparison.h"
+#include "runhistory.h"
+#include "trialqueue.h"
+
+#include <method.hpp>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
  
 class Window : public QWidget {
     
 public:
     Window(QWidget *parent = 0);
 
-    ~Window() = default;
+    ~Window();
 
     void setStrongin() noexcept;
     
@@ -23,7 +35,29 @@ public:
     void setScan() noexcept;
 
     void run();
+
+    void compare();
+
+    void stop();
+
+    void refresh();
+
+    void rangeChanged();
+
+    void selectRun(int index);
 private:
+    void finish();
+
+    void finishComparison();
+
+    void showResults(uint32_t countVal, double minVal, double pointVal);
+
+    [[nodiscard]] Objective makeObjective();
+
+    void sampleCurve(QCPGraph *graph, const BatchFunction &function, const TrialView *cache);
+
+    QLineEdit *formula;
+
     QLineEdit *evalA;
     QLineEdit *evalB;
     QLineEdit *evalC;
@@ -36,6 +70,8 @@ private:
     QLineEdit *eps;
     QLineEdit *maxCount;
 
+    QComboBox *lipschitz;
+
     QLineEdit *min;
     QLineEdit *x;
     QLineEdit *count;
@@ -46,7 +82,26 @@ private:
 
     QLabel *methodLabel;
 
+    QPushButton *runButton;
+    QPushButton *stopButton;
+    QPushButton *compareButton;
+
+    QComboBox   *runSelector;
+
     QCustomPlot *customPlot;
+    QTimer      *refreshTimer;
+
+    std::unique_ptr<RunHistory> history;
+    Run                        *current;
+    // Run whose results the labels show, only compared
+    const Run                  *displayed;
+    std::unique_ptr<Comparison> comparison;
+
+    std::thread       worker;
+    std::atomic<bool> finished;
+    CancellationToken token;
+    TrialQueue        queue;
+    TrialStream       stream;
 
     enum {
         PIYAVSKIY,
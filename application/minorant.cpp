@@ -0,0 +1,118 @@
+// Copyright Lebedev Alexander 2020
+#include "minorant.h"
+
+#include <algorithm>
+#include <cmath>
+
+MinorantOverlay::MinorantOverlay(QCustomPlot *plot)
+        : m_plot(plot),
+          m_m(0.)
+{
+    m_graph = m_plot->addGraph();
+    m_graph->setLineStyle(QCPGraph::lsLine);
+}
+
+MinorantOverlay::~MinorantOverlay()
+{
+    m_plot->removeGraph(m_graph);
+}
+
+void MinorantOverlay::add(const IMethod &method, const std::vector<Trial> &batch, double m)
+{
+    // Methods without a Lipschitz model report M = 0 and have nothing to draw
+    if (m <= 0.)
+    {
+        return;
+    }
+
+    bool changed = m != m_m;
+    m_m = m;
+
+    for (const auto &trial : batch)
+    {
+        auto it = std::upper_bound(m_trials.begin(), m_trials.end(), trial.x, [] (double x, const Trial &other) {
+            return x < other.x;
+        });
+        auto index = static_cast<size_t>(it - m_trials.begin());
+        m_trials.insert(it, trial);
+
+        if (!changed)
+        {
+            redraw(method, index ? index - 1 : 0, std::min(index + 1, m_trials.size() - 1));
+        }
+    }
+
+    if (changed)
+    {
+        rebuild(method);
+    }
+}
+
+void MinorantOverlay::clear()
+{
+    m_trials.clear();
+    m_graph->data()->clear();
+    m_m = 0.;
+}
+
+void MinorantOverlay::setColor(const QColor &color)
+{
+    m_graph->setPen(QPen(color, 1., Qt::DashLine));
+}
+
+void MinorantOverlay::setVisible(bool visible)
+{
+    m_graph->setVisible(visible);
+}
+
+bool MinorantOverlay::hasVertex(const Trial &vertex, size_t left) const
+{
+    return std::isfinite(vertex.z) &&
+           vertex.x > m_trials[left].x &&
+           vertex.x < m_trials[left + 1].x;
+}
+
+void MinorantOverlay::rebuild(const IMethod &method)
+{
+    QVector<QCPGraphData> points;
+    points.reserve(static_cast<int>(2 * m_trials.size()));
+
+    for (size_t i = 0; i < m_trials.size(); i++)
+    {
+        points.push_back(QCPGraphData(m_trials[i].x, m_trials[i].z));
+
+        if (i + 1 < m_trials.size())
+        {
+            auto vertex = method.getModelMinimum(m_trials[i], m_trials[i + 1], m_m);
+            if (hasVertex(vertex, i))
+            {
+                points.push_back(QCPGraphData(vertex.x, vertex.z));
+            }
+        }
+    }
+
+    m_graph->data()->set(points, true);
+}
+
+void MinorantOverlay::redraw(const IMethod &method, size_t left, size_t right)
+{
+    // Replaces everything drawn between the two trials, both ends included
+    m_graph->data()->remove(m_trials[left].x, m_trials[right].x);
+
+    QVector<QCPGraphData> points;
+    for (size_t i = left; i <= right; i++)
+    {
+        points.push_back(QCPGraphData(m_trials[i].x, m_trials[i].z));
+
+        if (i < right)
+        {
+            auto vertex = method.getModelMinimum(m_trials[i], m_trials[i + 1], m_m);
+            if (hasVertex(vertex, i))
+            {
+                points.push_back(QCPGraphData(vertex.x, vertex.z));
+            }
+        }
+    }
+
+    m_graph->data()->add(points, true);
+}
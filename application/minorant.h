@@ -0,0 +1,39 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+#include "3rdparty/qcustomplot.h"
+
+#include <method.hpp>
+
+#include <vector>
+
+// Draws the model a method builds between neighbouring trials: the saw-tooth
+// minorant for Piyavskiy, the scaled characteristics for Strongin. Only the
+// interval around each new trial is redrawn unless M itself has changed.
+class MinorantOverlay
+{
+public:
+    explicit MinorantOverlay(QCustomPlot *plot);
+
+    ~MinorantOverlay();
+
+    void add(const IMethod &method, const std::vector<Trial> &batch, double m);
+
+    void clear();
+
+    void setColor(const QColor &color);
+
+    void setVisible(bool visible);
+
+private:
+    void rebuild(const IMethod &method);
+
+    void redraw(const IMethod &method, size_t left, size_t right);
+
+    [[nodiscard]] bool hasVertex(const Trial &vertex, size_t left) const;
+
+    QCustomPlot       *m_plot;
+    QCPGraph          *m_graph;
+    std::vector<Trial> m_trials;
+    double             m_m;
+};
@@ -0,0 +1,114 @@
+// Copyright Lebedev Alexander 2020
+#include "runhistory.h"
+
+namespace
+{
+    const QColor palette[] = {
+        QColor(31, 119, 180),
+        QColor(255, 127, 14),
+        QColor(44, 160, 44),
+        QColor(214, 39, 40),
+        QColor(148, 103, 189),
+        QColor(140, 86, 75)
+    };
+}
+
+RunHistory::RunHistory(QCustomPlot *plot, size_t capacity)
+        : m_plot(plot),
+          m_capacity(capacity),
+          m_nextId(1),
+          m_shown(-1),
+          m_visible(true)
+{
+    // Empty constructor
+}
+
+RunHistory::~RunHistory()
+{
+    for (auto &run : m_runs)
+    {
+        m_plot->removeGraph(run->curve);
+    }
+}
+
+Run &RunHistory::start()
+{
+    std::unique_ptr<Run> run;
+
+    if (m_runs.size() >= m_capacity)
+    {
+        run = std::move(m_runs.front());
+        m_runs.pop_front();
+
+        run->method.reset();
+        run->curve->data()->clear();
+        run->trials->clear();
+        run->minorant->clear();
+    } else
+    {
+        run = std::make_unique<Run>();
+        run->curve = m_plot->addGraph();
+        run->trials = std::make_unique<TrialLod>(m_plot, -9.);
+        run->minorant = std::make_unique<MinorantOverlay>(m_plot);
+    }
+
+    auto color = palette[(m_nextId - 1) % (sizeof(palette) / sizeof(palette[0]))];
+    run->id = m_nextId++;
+    run->objective = Objective();
+    run->curve->setPen(QPen(color));
+    run->trials->setColor(color);
+    run->minorant->setColor(color);
+    run->count = 0;
+    run->min = 0.;
+    run->point = 0.;
+
+    m_runs.push_back(std::move(run));
+    m_visible = true;
+    show(m_shown < 0 ? -1 : static_cast<int>(m_runs.size()) - 1);
+
+    return *m_runs.back();
+}
+
+void RunHistory::show(int index)
+{
+    m_shown = index;
+
+    for (size_t i = 0; i < m_runs.size(); i++)
+    {
+        bool visible = isShown(*m_runs[i]);
+        m_runs[i]->curve->setVisible(visible);
+        m_runs[i]->trials->setVisible(visible);
+        m_runs[i]->minorant->setVisible(visible);
+    }
+}
+
+void RunHistory::setVisible(bool visible)
+{
+    m_visible = visible;
+    show(m_shown);
+}
+
+bool RunHistory::isShown(const Run &run) const
+{
+    return m_visible && (m_shown < 0 || m_runs[m_shown].get() == &run);
+}
+
+bool RunHistory::isOverlaid() const noexcept
+{
+    return m_shown < 0;
+}
+
+size_t RunHistory::size() const noexcept
+{
+    return m_runs.size();
+}
+
+Run &RunHistory::at(size_t index)
+{
+    return *m_runs[index];
+}
+
+Run *RunHistory::latest()
+{
+    return m_runs.empty() ? nullptr : m_runs.back().get();
+}
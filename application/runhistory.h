@@ -0,0 +1,61 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+#include "3rdparty/qcustomplot.h"
+#include "minorant.h"
+#include "triallod.h"
+
+#include <method.hpp>
+
+#include <deque>
+#include <memory>
+
+struct Run
+{
+    int                              id;
+    Objective                        objective;
+    std::unique_ptr<IMethod>         method;
+    QCPGraph                        *curve;
+    std::unique_ptr<TrialLod>        trials;
+    std::unique_ptr<MinorantOverlay> minorant;
+
+    uint32_t count;
+    double   min;
+    double   point;
+};
+
+// Keeps the plottables and results of the last runs. Starting a run past the
+// capacity releases the oldest one and reuses its graphs for the new run.
+class RunHistory
+{
+public:
+    RunHistory(QCustomPlot *plot, size_t capacity);
+
+    ~RunHistory();
+
+    Run &start();
+
+    // Shows one run by position, or overlays all of them for a negative index
+    void show(int index);
+
+    // Hides or restores every kept run without changing the selection
+    void setVisible(bool visible);
+
+    [[nodiscard]] bool isShown(const Run &run) const;
+
+    [[nodiscard]] bool isOverlaid() const noexcept;
+
+    [[nodiscard]] size_t size() const noexcept;
+
+    [[nodiscard]] Run &at(size_t index);
+
+    [[nodiscard]] Run *latest();
+
+private:
+    QCustomPlot                     *m_plot;
+    size_t                           m_capacity;
+    std::deque<std::unique_ptr<Run>> m_runs;
+    int                              m_nextId;
+    int                              m_shown;
+    bool                             m_visible;
+};
@@ -0,0 +1,133 @@
+// Copyright Lebedev Alexander 2020
+#include "triallod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+namespace
+{
+    // Above this many visible trials markers overlap and cost more than they show
+    constexpr size_t markerLimit = 2000;
+
+    constexpr double stripHeight = 1.;
+}
+
+TrialLod::TrialLod(QCustomPlot *plot, double baseline)
+        : m_plot(plot),
+          m_baseline(baseline)
+{
+    m_markers = m_plot->addGraph();
+    m_markers->setPen(QColor(50, 50, 50, 255));
+    m_markers->setLineStyle(QCPGraph::lsNone);
+    m_markers->setScatterStyle(QCPScatterStyle(QCPScatterStyle::ssCircle, 4));
+
+    m_density = new QCPBars(m_plot->xAxis, m_plot->yAxis);
+    m_density->setPen(Qt::NoPen);
+    m_density->setBrush(QColor(50, 50, 50, 255));
+    m_density->setWidthType(QCPBars::wtPlotCoords);
+    m_density->setBaseValue(m_baseline - 0.5 * stripHeight);
+}
+
+TrialLod::~TrialLod()
+{
+    m_plot->removePlottable(m_density);
+    m_plot->removeGraph(m_markers);
+}
+
+void TrialLod::add(const std::vector<double> &sorted)
+{
+    auto middle = m_x.size();
+    m_x.insert(m_x.end(), sorted.begin(), sorted.end());
+    std::inplace_merge(m_x.begin(), m_x.begin() + middle, m_x.end());
+}
+
+void TrialLod::clear()
+{
+    m_x.clear();
+    m_markers->data()->clear();
+    m_density->data()->clear();
+}
+
+void TrialLod::setColor(const QColor &color)
+{
+    m_markers->setPen(color);
+    m_density->setBrush(color);
+}
+
+void TrialLod::setVisible(bool visible)
+{
+    m_markers->setVisible(visible);
+    m_density->setVisible(visible);
+}
+
+size_t TrialLod::size() const noexcept
+{
+    return m_x.size();
+}
+
+void TrialLod::update()
+{
+    auto range = m_plot->xAxis->range();
+    auto first = std::lower_bound(m_x.begin(), m_x.end(), range.lower) - m_x.begin();
+    auto last = std::upper_bound(m_x.begin(), m_x.end(), range.upper) - m_x.begin();
+
+    if (static_cast<size_t>(last - first) <= markerLimit)
+    {
+        showMarkers(first, last);
+    } else
+    {
+        showDensity(first, last);
+    }
+}
+
+void TrialLod::showMarkers(size_t first, size_t last)
+{
+    QVector<QCPGraphData> points(static_cast<int>(last - first));
+    for (size_t i = first; i < last; i++)
+    {
+        points[static_cast<int>(i - first)] = QCPGraphData(m_x[i], m_baseline);
+    }
+
+    m_markers->data()->set(points, true);
+    m_density->data()->clear();
+}
+
+void TrialLod::showDensity(size_t first, size_t last)
+{
+    auto range = m_plot->xAxis->range();
+    int columns = std::max(1, m_plot->axisRect()->width());
+    double step = range.size() / columns;
+
+    // Column edges are found by binary search, so the cost depends on the
+    // plot width and not on the number of trials
+    std::vector<size_t> counts(columns);
+    size_t maxCount = 0;
+    auto begin = m_x.begin() + first;
+    for (int column = 0; column < columns; column++)
+    {
+        auto edge = column + 1 == columns
+                        ? m_x.begin() + last
+                        : std::upper_bound(begin, m_x.begin() + last, range.lower + (column + 1) * step);
+        counts[column] = static_cast<size_t>(std::distance(begin, edge));
+        maxCount = std::max(maxCount, counts[column]);
+        begin = edge;
+    }
+
+    QVector<QCPBarsData> bars;
+    bars.reserve(columns);
+    double scale = stripHeight / std::log1p(static_cast<double>(maxCount));
+    for (int column = 0; column < columns; column++)
+    {
+        if (counts[column])
+        {
+            double height = std::log1p(static_cast<double>(counts[column])) * scale;
+            // Bars are drawn from the base value, the value is the height itself
+            bars.push_back(QCPBarsData(range.lower + (column + 0.5) * step, height));
+        }
+    }
+
+    m_density->setWidth(step);
+    m_density->data()->set(bars, true);
+    m_markers->data()->clear();
+}
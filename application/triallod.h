@@ -0,0 +1,41 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+#include "3rdparty/qcustomplot.h"
+
+#include <vector>
+
+// Level of detail layer for the trial scatter. Few visible trials are drawn
+// as markers, many are binned per pixel column and drawn as a density strip.
+class TrialLod
+{
+public:
+    TrialLod(QCustomPlot *plot, double baseline);
+
+    ~TrialLod();
+
+    // Merges trials sorted by x into the store
+    void add(const std::vector<double> &sorted);
+
+    void clear();
+
+    void setColor(const QColor &color);
+
+    void setVisible(bool visible);
+
+    // Rebuilds the drawn representation for the current key axis range
+    void update();
+
+    [[nodiscard]] size_t size() const noexcept;
+
+private:
+    void showMarkers(size_t first, size_t last);
+
+    void showDensity(size_t first, size_t last);
+
+    QCustomPlot        *m_plot;
+    QCPGraph           *m_markers;
+    QCPBars            *m_density;
+    double              m_baseline;
+    std::vector<double> m_x;
+};
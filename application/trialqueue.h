@@ -0,0 +1,94 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+#include <progress.hpp>
+#include <trials.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Bounded single producer / single consumer ring of trials.
+// The search thread pushes, the GUI thread drains on its refresh timer.
+class TrialQueue
+{
+public:
+    explicit TrialQueue(size_t capacity = 1 << 16)
+            : m_buffer(capacity),
+              m_mask(capacity - 1),
+              m_head(0),
+              m_tail(0)
+    {
+        // Capacity must be a power of two
+    }
+
+    // Waits while the queue is full. Gives up and drops the trial once the
+    // token is cancelled, the GUI stops draining before it joins the search.
+    bool push(const Trial &trial, const CancellationToken *token = nullptr)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        while (tail - m_head.load(std::memory_order_acquire) > m_mask)
+        {
+            if (token && token->isCancelled())
+            {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+
+        m_buffer[tail & m_mask] = trial;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <typename Consumer>
+    size_t drain(Consumer consumer)
+    {
+        auto head = m_head.load(std::memory_order_relaxed);
+        auto tail = m_tail.load(std::memory_order_acquire);
+
+        for (auto i = head; i != tail; i++)
+        {
+            consumer(m_buffer[i & m_mask]);
+        }
+
+        m_head.store(tail, std::memory_order_release);
+        return tail - head;
+    }
+
+    void clear() noexcept
+    {
+        m_head.store(m_tail.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    std::vector<Trial>  m_buffer;
+    size_t              m_mask;
+    std::atomic<size_t> m_head;
+    std::atomic<size_t> m_tail;
+};
+
+// Observer forwarding every trial of a running method into a queue.
+class TrialStream final : public IObserver
+{
+public:
+    explicit TrialStream(TrialQueue &queue) : m_queue(queue), m_token(nullptr) { }
+
+    // Cancelling it releases a search blocked on a full queue
+    void setCancellationToken(const CancellationToken *token)
+    {
+        m_token = token;
+    }
+
+    void onProgress(const Progress &progress) override { }
+
+    void onTrial(const Trial &trial) override
+    {
+        m_queue.push(trial, m_token);
+    }
+
+private:
+    TrialQueue              &m_queue;
+    const CancellationToken *m_token;
+};
@@ -0,0 +1,94 @@
+// Copyright Lebedev Alexander 2020
+#include <expression.hpp>
+#include <jit.hpp>
+#include <native.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    constexpr size_t pointCount = 10000000;
+    constexpr size_t blockSize = 4096;
+
+    template <typename Block>
+    double measure(const char *name, const std::vector<double> &x, std::vector<double> *z, Block block)
+    {
+        auto start = Clock::now();
+        for (size_t i = 0; i < x.size(); i += blockSize)
+        {
+            block(x.data() + i, z->data() + i, std::min(blockSize, x.size() - i));
+        }
+        auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        double checksum = 0.;
+        for (double value : *z)
+        {
+            checksum += value;
+        }
+        std::printf("%-13s %10.2f %10.2f   %.6e\n", name, seconds * 1e3, seconds * 1e9 / x.size(), checksum);
+        return seconds;
+    }
+
+    template <typename Function>
+    void compare(const char *formula, Function function, const std::vector<double> &x, std::vector<double> *z)
+    {
+        const std::map<std::string, double> parameters = {{"a", 2.}, {"b", 3.}, {"c", 3.}, {"d", 5.}};
+        Expression plain(formula, parameters, false);
+        Expression expression(formula, parameters);
+        JitExpression jit(expression);
+        NativeExpression native(expression);
+
+        std::printf("\n%s: %zu instructions, %zu unoptimized\n", formula, expression.getCode().size(), plain.getCode().size());
+        std::printf("%-13s %10s %10s   %s\n", "engine", "total ms", "ns/point", "checksum");
+        measure("hand-written", x, z, [&function] (const double *x, double *z, size_t count) {
+            for (size_t i = 0; i < count; i++)
+            {
+                z[i] = function(x[i]);
+            }
+        });
+        measure("vm scalar", x, z, [&expression] (const double *x, double *z, size_t count) {
+            for (size_t i = 0; i < count; i++)
+            {
+                z[i] = expression.evaluate(x[i]);
+            }
+        });
+        measure("vm block -O0", x, z, [&plain] (const double *x, double *z, size_t count) {
+            plain.evaluate(x, z, count);
+        });
+        measure("vm block", x, z, [&expression] (const double *x, double *z, size_t count) {
+            expression.evaluate(x, z, count);
+        });
+        std::vector<double> derivative(x.size());
+        measure("vm derivative", x, z, [&expression, &derivative, &x] (const double *points, double *z, size_t count) {
+            expression.evaluateDerivative(points, z, derivative.data() + (points - x.data()), count);
+        });
+        measure(jit.isCompiled() ? "jit" : "jit (vm)", x, z, [&jit] (const double *x, double *z, size_t count) {
+            jit.evaluate(x, z, count);
+        });
+        measure(native.isCompiled() ? "native code" : "native (vm)", x, z, [&native] (const double *x, double *z, size_t count) {
+            native.evaluate(x, z, count);
+        });
+    }
+}
+
+int main()
+{
+    std::vector<double> x(pointCount);
+    std::vector<double> z(pointCount);
+    for (size_t i = 0; i < pointCount; i++)
+    {
+        x[i] = 8. * static_cast<double>(i) / pointCount;
+    }
+
+    compare("a*sin(b*x) + c*cos(d*x)", [] (double x) { return 2. * std::sin(3. * x) + 3. * std::cos(5. * x); }, x, &z);
+    compare("a*sin(b*x) + c*cos(b*x)", [] (double x) { return 2. * std::sin(3. * x) + 3. * std::cos(3. * x); }, x, &z);
+
+    return 0;
+}
@@ -0,0 +1,557 @@
+// Copyright Lebedev Alexander 2020
+#include <branchbound.hpp>
+#include <cache.hpp>
+#include <expression.hpp>
+#include <jit.hpp>
+#include <method.hpp>
+#include <native.hpp>
+#include <plugin.hpp>
+#include <workers.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    const char *usage =
+        "Usage: solver [options]\n"
+        "  --objective formula   F(x), e.g. 'a*sin(b*x) + c*cos(d*x)' (default 2*sin(3*x) + 3*cos(5*x));\n"
+        "                        four numbers a,b,c,d stand for a*sin(b*x) + c*cos(d*x)\n"
+        "  --parameters list     values of the formula parameters, e.g. a=2,b=3\n"
+        "  --x1 value            left boundary (default 0)\n"
+        "  --x2 value            right boundary (default 8)\n"
+        "  --method name         strongin, piyavskiy, scan or interval (default strongin)\n"
+        "  --parameter value     reliability parameter r (default 1.1)\n"
+        "  --eps value           accuracy (default 0.01)\n"
+        "  --max-count value     maximal trial count (default 800)\n"
+        "  --batch value         trials evaluated together per iteration (default 1)\n"
+        "  --lipschitz name      M from the sampled estimate, the bound of |F'| or the tighter of both:\n"
+        "                        estimate, bound or tighter (default estimate)\n"
+        "  --pruning tolerance   retire intervals whose lower bound exceeds the best value minus tolerance\n"
+        "  --bounds name         lower bounds for pruning: model, natural or centered (default centered)\n"
+        "  --threads value       threads of the interval method, 0 for all cores (default 0)\n"
+        "  --engine name         vm, jit or native, how the formula is evaluated (default jit);\n"
+        "                        native builds it with $CXX and caches the object in $SPPR_CACHE\n"
+        "                        or ~/.cache/sppr\n"
+        "  --plugin path         load F(x) from a shared library implementing objective_plugin.h\n"
+        "                        instead of a formula; pruning then uses the model bounds\n"
+        "  --plugin-arguments text  argument string passed to the plugin\n"
+        "  --early-abort name    yes or no, let plugins stop evaluations that cannot give a new\n"
+        "                        minimum (default yes)\n"
+        "  --workers value       evaluate F(x) in that many worker processes, restarted when they crash\n"
+        "  --cache path          memoize evaluations in that file across runs, 'default' for\n"
+        "                        evaluations.cache in $SPPR_CACHE or ~/.cache/sppr\n"
+        "  --coarse formula      cheap approximation of the objective with the same parameters; the search\n"
+        "                        runs on it plus a bias model and confirms candidates with the objective\n"
+        "  --confirm tolerance   confirm points predicted below the best value plus tolerance (default 0)\n"
+        "  --file path           read options from a file, one 'name value' per line\n"
+        "  --timings             report every trial with the time of its iteration\n";
+
+    // Records every trial together with the time elapsed since the previous one
+    class TimingObserver final : public IObserver
+    {
+    public:
+        struct Record
+        {
+            Trial  trial;
+            double microseconds;
+        };
+
+        TimingObserver() : m_last(Clock::now()) { }
+
+        void onProgress(const Progress &progress) override { }
+
+        void onTrial(const Trial &trial) override
+        {
+            auto now = Clock::now();
+            m_records.push_back({trial, std::chrono::duration<double, std::micro>(now - m_last).count()});
+            m_last = now;
+        }
+
+        [[nodiscard]] const std::vector<Record> &records() const noexcept
+        {
+            return m_records;
+        }
+
+    private:
+        Clock::time_point   m_last;
+        std::vector<Record> m_records;
+    };
+
+    bool parseNumber(const std::string &text, double *value)
+    {
+        char *end = nullptr;
+        *value = std::strtod(text.c_str(), &end);
+        return !text.empty() && *end == '\0' && std::isfinite(*value);
+    }
+
+    bool parseList(const std::string &text, std::vector<double> *values)
+    {
+        std::stringstream stream(text);
+        std::string item;
+        values->clear();
+
+        while (std::getline(stream, item, ','))
+        {
+            double value;
+            if (!parseNumber(item, &value))
+            {
+                return false;
+            }
+            values->push_back(value);
+        }
+        return true;
+    }
+
+    bool parseParameters(const std::string &text, std::map<std::string, double> *parameters)
+    {
+        std::stringstream stream(text);
+        std::string item;
+
+        while (std::getline(stream, item, ','))
+        {
+            auto separator = item.find('=');
+            double value;
+            if (separator == std::string::npos || !parseNumber(item.substr(separator + 1), &value))
+            {
+                return false;
+            }
+            (*parameters)[item.substr(0, separator)] = value;
+        }
+        return true;
+    }
+
+    bool readFile(const std::string &path, std::map<std::string, std::string> *options)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::stringstream stream(line);
+            std::string name;
+            std::string value;
+            if (!(stream >> name) || name[0] == '#')
+            {
+                continue;
+            }
+            std::getline(stream >> std::ws, value);
+            (*options)[name] = value;
+        }
+        return true;
+    }
+
+    std::string quote(const std::string &text)
+    {
+        std::string result = "\"";
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result += '\\';
+            }
+            result += c;
+        }
+        return result + "\"";
+    }
+
+    // JSON has no literal for infinities and NaN
+    std::string number(double value)
+    {
+        if (!std::isfinite(value))
+        {
+            return "null";
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.17g", value);
+        return text;
+    }
+
+    int fail(const std::string &message)
+    {
+        std::cerr << "solver: " << message << "\n" << usage;
+        return 1;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::map<std::string, std::string> options = {
+        {"objective", "2*sin(3*x) + 3*cos(5*x)"},
+        {"parameters", ""},
+        {"x1", "0"},
+        {"x2", "8"},
+        {"method", "strongin"},
+        {"parameter", "1.1"},
+        {"eps", "0.01"},
+        {"max-count", "800"},
+        {"batch", "1"},
+        {"engine", "jit"},
+        {"pruning", ""},
+        {"bounds", "centered"},
+        {"threads", "0"},
+        {"lipschitz", "estimate"},
+        {"plugin", ""},
+        {"plugin-arguments", ""},
+        {"workers", ""},
+        {"cache", ""},
+        {"coarse", ""},
+        {"confirm", "0"},
+        {"early-abort", "yes"}
+    };
+    bool timings = false;
+
+    // Options from a file come first, so the command line can override them
+    std::map<std::string, std::string> arguments;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--help" || argument == "-h")
+        {
+            std::cout << usage;
+            return 0;
+        }
+        if (argument == "--timings")
+        {
+            timings = true;
+            continue;
+        }
+        if (argument.compare(0, 2, "--") != 0 || i + 1 >= argc)
+        {
+            return fail("unexpected argument '" + argument + "'");
+        }
+        arguments[argument.substr(2)] = argv[++i];
+    }
+
+    if (arguments.count("file"))
+    {
+        if (!readFile(arguments["file"], &options))
+        {
+            return fail("cannot read '" + arguments["file"] + "'");
+        }
+        arguments.erase("file");
+        if (options.count("timings"))
+        {
+            timings = options["timings"] != "0";
+            options.erase("timings");
+        }
+    }
+
+    for (const auto &argument : arguments)
+    {
+        options[argument.first] = argument.second;
+    }
+
+    std::map<std::string, double> parameters;
+    std::vector<double> coefficients;
+    std::string formula = options["objective"];
+    double x1;
+    double x2;
+    double parameter;
+    double eps;
+    double maxCount;
+    double batch;
+    double pruning = 0.;
+    double threads;
+    double workers = 0.;
+    double confirm;
+
+    if (!parseParameters(options["parameters"], &parameters))
+    {
+        return fail("parameters expect comma separated name=value pairs");
+    }
+    if (parseList(formula, &coefficients) && coefficients.size() == 4)
+    {
+        formula = "a*sin(b*x) + c*cos(d*x)";
+        parameters = {{"a", coefficients[0]}, {"b", coefficients[1]}, {"c", coefficients[2]}, {"d", coefficients[3]}};
+    }
+    if (!parseNumber(options["x1"], &x1) || !parseNumber(options["x2"], &x2) || x1 >= x2)
+    {
+        return fail("invalid boundaries");
+    }
+    if (!parseNumber(options["parameter"], &parameter) ||
+        !parseNumber(options["eps"], &eps) ||
+        !parseNumber(options["max-count"], &maxCount) || maxCount < 0 ||
+        !parseNumber(options["batch"], &batch) || batch < 1 ||
+        !parseNumber(options["threads"], &threads) || threads < 0 ||
+        !parseNumber(options["confirm"], &confirm) || confirm < 0 ||
+        (!options["workers"].empty() && (!parseNumber(options["workers"], &workers) || workers < 1)) ||
+        (!options["pruning"].empty() && (!parseNumber(options["pruning"], &pruning) || pruning < 0)))
+    {
+        return fail("invalid numeric option");
+    }
+
+    const auto &bounds = options["bounds"];
+    if (bounds != "model" && bounds != "natural" && bounds != "centered")
+    {
+        return fail("unknown bounds '" + bounds + "'");
+    }
+    auto form = bounds == "natural" ? IntervalForm::Natural : IntervalForm::Centered;
+
+    // Enclosures are only available for formulas, the fingerprint keys the cache
+    std::string fingerprint;
+    std::unique_ptr<Expression> function;
+    std::shared_ptr<PluginObjective> plugin;
+    std::function<double(double)> objective;
+    BatchFunction batchObjective;
+    BoundedFunction bounded;
+    EnclosureFunction enclosure;
+    EnclosureFunction derivative;
+    std::unique_ptr<JitExpression> compiled;
+    std::unique_ptr<NativeExpression> native;
+    if (!options["plugin"].empty())
+    {
+        plugin = std::make_shared<PluginObjective>(options["plugin"], options["plugin-arguments"]);
+        if (!plugin->isLoaded())
+        {
+            return fail("plugin: " + plugin->getError());
+        }
+        fingerprint = plugin->getFingerprint();
+        auto loaded = makeObjective(plugin);
+        objective = loaded.function;
+        batchObjective = loaded.batch;
+        bounded = loaded.bounded;
+    } else
+    {
+        function = std::make_unique<Expression>(formula, parameters);
+        if (!function->isValid())
+        {
+            return fail("objective: " + function->getError());
+        }
+
+        fingerprint = NativeExpression::generate(*function);
+        const auto *expression = function.get();
+        objective = [expression] (double x) { return expression->evaluate(x); };
+        batchObjective = [expression] (const double *x, double *z, size_t size) {
+            expression->evaluate(x, z, size);
+        };
+        enclosure = [expression, form] (const Interval &x) { return expression->enclose(x, form); };
+        derivative = [expression] (const Interval &x) { return expression->encloseDerivative(x); };
+    }
+
+    if (plugin)
+    {
+        // The engine only applies to formulas
+    } else if (options["engine"] == "jit")
+    {
+        compiled = std::make_unique<JitExpression>(*function);
+        const auto *jit = compiled.get();
+        objective = [jit] (double x) { return jit->evaluate(x); };
+        batchObjective = [jit] (const double *x, double *z, size_t size) {
+            jit->evaluate(x, z, size);
+        };
+    } else if (options["engine"] == "native")
+    {
+        native = std::make_unique<NativeExpression>(*function);
+        if (!native->isCompiled())
+        {
+            std::cerr << "solver: " << native->getError() << ", using the interpreter\n";
+        }
+        const auto *library = native.get();
+        objective = [library] (double x) { return library->evaluate(x); };
+        batchObjective = [library] (const double *x, double *z, size_t size) {
+            library->evaluate(x, z, size);
+        };
+    } else if (options["engine"] != "vm")
+    {
+        return fail("unknown engine '" + options["engine"] + "'");
+    }
+
+    // Forked before the methods start any threads
+    std::shared_ptr<WorkerPool> pool;
+    if (workers >= 1)
+    {
+        pool = std::make_shared<WorkerPool>(objective, static_cast<uint32_t>(workers), batchObjective);
+        if (!pool->isRunning())
+        {
+            std::cerr << "solver: " << pool->getError() << ", evaluating in process\n";
+        }
+        auto pooled = makeObjective(pool);
+        objective = pooled.function;
+        batchObjective = pooled.batch;
+    }
+
+    std::unique_ptr<IMethod> method;
+    std::unique_ptr<BranchAndBoundMethod> boxes;
+    auto count = static_cast<uint32_t>(maxCount);
+    const auto &name = options["method"];
+    if (name == "strongin")
+    {
+        method = std::make_unique<StronginMethod>(count, eps, parameter, objective);
+    } else if (name == "piyavskiy")
+    {
+        method = std::make_unique<PiyavskiyMethod>(count, eps, parameter, objective);
+    } else if (name == "scan")
+    {
+        method = std::make_unique<SeqScanMethod>(count, eps, objective);
+    } else if (name == "interval")
+    {
+        if (!enclosure)
+        {
+            return fail("the interval method needs a formula objective");
+        }
+        boxes = std::make_unique<BranchAndBoundMethod>(count, eps, objective, enclosure, derivative,
+                                                       static_cast<uint32_t>(threads));
+    } else
+    {
+        return fail("unknown method '" + name + "'");
+    }
+
+    const auto &earlyAbort = options["early-abort"];
+    if (earlyAbort != "yes" && earlyAbort != "no")
+    {
+        return fail("unknown early-abort '" + earlyAbort + "'");
+    }
+    // Workers isolate the objective, so it is not called in process
+    bool aborting = method && bounded && !pool && earlyAbort == "yes";
+    if (aborting)
+    {
+        method->setBounded(bounded);
+    }
+
+    // The coarse formula is cheap by assumption, the interpreter is enough
+    std::unique_ptr<Expression> coarse;
+    if (!options["coarse"].empty())
+    {
+        if (!method || name == "scan")
+        {
+            return fail("the coarse objective needs the strongin or piyavskiy method");
+        }
+        coarse = std::make_unique<Expression>(options["coarse"], parameters);
+        if (!coarse->isValid())
+        {
+            return fail("coarse: " + coarse->getError());
+        }
+        const auto *approximation = coarse.get();
+        method->setCoarse([approximation] (double x) { return approximation->evaluate(x); }, confirm);
+    }
+
+    std::shared_ptr<EvaluationCache> cache;
+    if (!options["cache"].empty())
+    {
+        cache = std::make_shared<EvaluationCache>(fingerprint, options["cache"] == "default" ? "" : options["cache"]);
+        if (!cache->isOpen())
+        {
+            std::cerr << "solver: " << cache->getError() << ", not caching\n";
+        }
+        if (method)
+        {
+            method->setCache(cache);
+        } else
+        {
+            boxes->setCache(cache);
+        }
+    }
+
+    if (method)
+    {
+        method->setBatch(static_cast<uint32_t>(batch), batchObjective);
+    }
+
+    const auto &lipschitz = options["lipschitz"];
+    if (lipschitz != "estimate" && lipschitz != "bound" && lipschitz != "tighter")
+    {
+        return fail("unknown lipschitz '" + lipschitz + "'");
+    }
+    if (lipschitz != "estimate" && !derivative)
+    {
+        return fail("the lipschitz " + lipschitz + " needs a formula objective");
+    }
+    if (method)
+    {
+        auto mode = lipschitz == "bound" ? LipschitzMode::Bound
+                  : lipschitz == "tighter" ? LipschitzMode::Tighter
+                  : LipschitzMode::Estimate;
+        method->setLipschitz(mode, derivative);
+    }
+
+    if (method && !options["pruning"].empty())
+    {
+        method->setPruning(pruning);
+        if (bounds != "model" && enclosure)
+        {
+            method->setEnclosure(enclosure);
+        }
+    }
+
+    TimingObserver observer;
+    if (timings && method)
+    {
+        method->setObserver(&observer, 0);
+    } else if (timings)
+    {
+        boxes->setObserver(&observer, 0);
+    }
+
+    uint32_t resultCount = 0;
+    double min = 0.;
+    double point = 0.;
+
+    auto start = Clock::now();
+    if (method)
+    {
+        method->execute(&resultCount, &min, &point, x1, x2);
+    } else
+    {
+        boxes->execute(&resultCount, &min, &point, x1, x2);
+    }
+    auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    std::printf("{\"method\":%s,\"count\":%u,\"min\":%s,\"point\":%s,\"m\":%s,\"time_ms\":%.6f",
+                quote(name).c_str(), resultCount, number(min).c_str(), number(point).c_str(),
+                number(method ? method->getState().m : 0.).c_str(), elapsed);
+    if (boxes)
+    {
+        // The global minimum is proven to lie in [lower, min]
+        std::printf(",\"lower\":%s", number(boxes->getLowerBound()).c_str());
+    }
+    if (aborting)
+    {
+        std::printf(",\"bounded\":%u", method->getBoundedCount());
+    }
+    if (coarse)
+    {
+        std::printf(",\"fine\":%u", method->getFineCount());
+    }
+    if (cache)
+    {
+        std::printf(",\"cache_hits\":%llu,\"cache_misses\":%llu",
+                    static_cast<unsigned long long>(cache->getHits()),
+                    static_cast<unsigned long long>(cache->getMisses()));
+    }
+    if (pool)
+    {
+        std::printf(",\"restarts\":%u,\"failures\":%u", pool->getRestarts(), pool->getFailures());
+    }
+
+    if (timings)
+    {
+        std::printf(",\"trials\":[");
+        const auto &records = observer.records();
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            std::printf("%s{\"x\":%s,\"z\":%s,\"us\":%.3f}", i ? "," : "", number(records[i].trial.x).c_str(),
+                        number(records[i].trial.z).c_str(), records[i].microseconds);
+        }
+        std::printf("]");
+    }
+    std::printf("}\n");
+
+    return 0;
+}
@@ -0,0 +1,252 @@
+// Copyright Lebedev Alexander 2020
+#include "branchbound.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+
+namespace
+{
+    // Rounds with fewer boxes are not worth a thread hand-off
+    constexpr size_t parallelThreshold = 32;
+
+    // Boxes taken from the queue per thread and round
+    constexpr size_t boxesPerThread = 4;
+}
+
+BranchAndBoundMethod::BranchAndBoundMethod(uint32_t count,
+                                           double eps,
+                                           std::function<double(double)> function,
+                                           EnclosureFunction enclosure,
+                                           EnclosureFunction derivative,
+                                           uint32_t threads)
+        : m_maxCount(count),
+          m_eps(eps),
+          m_function(function),
+          m_enclosure(enclosure),
+          m_derivative(derivative),
+          m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+          m_observer(nullptr),
+          m_reportIterations(0),
+          m_token(nullptr),
+          m_lowerBound(std::numeric_limits<double>::lowest())
+{
+    // Empty constructor
+}
+
+void BranchAndBoundMethod::setObserver(IObserver *observer, uint32_t iterations)
+{
+    m_observer = observer;
+    m_reportIterations = iterations;
+}
+
+void BranchAndBoundMethod::setCancellationToken(const CancellationToken *token)
+{
+    m_token = token;
+}
+
+void BranchAndBoundMethod::setCache(std::shared_ptr<EvaluationCache> cache)
+{
+    m_cache = std::move(cache);
+}
+
+double BranchAndBoundMethod::f(double x) const
+{
+    if (m_cache)
+    {
+        return m_cache->evaluate(x, m_function);
+    }
+    return m_function(x);
+}
+
+SearchState BranchAndBoundMethod::getState() const
+{
+    return m_state.load();
+}
+
+double BranchAndBoundMethod::getLowerBound() const noexcept
+{
+    return m_lowerBound;
+}
+
+void BranchAndBoundMethod::split(const Box &box, Split *result) const
+{
+    auto middle = 0.5 * (box.x1 + box.x2);
+    const Interval halves[] = {{box.x1, middle}, {middle, box.x2}};
+
+    result->childCount = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        const auto &half = halves[i];
+        if (m_derivative)
+        {
+            auto slope = m_derivative(half);
+            if (slope.lo > 0. || slope.hi < 0.)
+            {
+                auto x = slope.lo > 0. ? half.lo : half.hi;
+                result->trials[i] = {x, f(x)};
+                continue;
+            }
+        }
+
+        auto x = half.mid();
+        result->trials[i] = {x, f(x)};
+        result->children[result->childCount++] = {half.lo, half.hi, m_enclosure(half).lo};
+    }
+}
+
+void BranchAndBoundMethod::processRound(const std::vector<Box> &boxes, std::vector<Split> &splits) const
+{
+    splits.resize(boxes.size());
+
+    if (m_threads < 2 || boxes.size() < parallelThreshold)
+    {
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            split(boxes[i], &splits[i]);
+        }
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunk = (boxes.size() + m_threads - 1) / m_threads;
+
+    for (size_t begin = 0; begin < boxes.size(); begin += chunk)
+    {
+        size_t end = std::min(boxes.size(), begin + chunk);
+        workers.emplace_back([this, &boxes, &splits, begin, end] {
+            for (size_t i = begin; i < end; i++)
+            {
+                split(boxes[i], &splits[i]);
+            }
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void BranchAndBoundMethod::execute(uint32_t *count, double *min, double *point, double x1, double x2)
+{
+    auto byLowerBound = [] (const Box &lhs, const Box &rhs) {
+        return lhs.lower > rhs.lower;
+    };
+    // Binary heap with the lowest bound in front
+    std::vector<Box> queue;
+    auto push = [&queue, &byLowerBound] (const Box &box) {
+        queue.push_back(box);
+        std::push_heap(queue.begin(), queue.end(), byLowerBound);
+    };
+
+    double globalMin = std::numeric_limits<double>::max();
+    double currPoint = x1;
+    uint32_t currCount = 0;
+    uint32_t reported = 0;
+
+    auto report = [this, &globalMin, &currPoint, &currCount, &queue] {
+        m_observer->onProgress({currCount, globalMin, currPoint, 0., queue.size()});
+    };
+
+    auto addTrial = [&] (const Trial &trial) {
+        if (trial.z < globalMin)
+        {
+            globalMin = trial.z;
+            currPoint = trial.x;
+        }
+
+        currCount++;
+        m_state.publish({currCount, globalMin, currPoint, 0.});
+
+        if (m_observer)
+        {
+            m_observer->onTrial(trial);
+            if (m_reportIterations && currCount % m_reportIterations == 0)
+            {
+                report();
+                reported = currCount;
+            }
+        }
+    };
+
+    addTrial({x1, f(x1)});
+    addTrial({x2, f(x2)});
+    push({x1, x2, m_enclosure({x1, x2}).lo});
+
+    // Lowest bound among boxes narrower than eps, they are not split further
+    double settled = std::numeric_limits<double>::max();
+
+    std::vector<Box> boxes;
+    std::vector<Split> splits;
+    // Rounds are at least large enough to be split across the threads
+    size_t roundSize = m_threads < 2 ? 1 : std::max(parallelThreshold, m_threads * boxesPerThread);
+
+    while (!queue.empty() && currCount < m_maxCount)
+    {
+        if (m_token && m_token->isCancelled())
+        {
+            break;
+        }
+
+        boxes.clear();
+        while (!queue.empty() && boxes.size() < roundSize)
+        {
+            auto box = queue.front();
+            if (box.lower > globalMin)
+            {
+                // Every other box in the queue is worse
+                queue.clear();
+                break;
+            }
+            std::pop_heap(queue.begin(), queue.end(), byLowerBound);
+            queue.pop_back();
+
+            if (box.x2 - box.x1 < m_eps)
+            {
+                settled = std::min(settled, box.lower);
+                continue;
+            }
+            boxes.push_back(box);
+        }
+
+        // Two trials per box, stay within the budget
+        size_t budget = std::max<uint32_t>(1, (m_maxCount - currCount) / 2);
+        for (size_t i = budget; i < boxes.size(); i++)
+        {
+            push(boxes[i]);
+        }
+        boxes.resize(std::min(boxes.size(), budget));
+
+        processRound(boxes, splits);
+
+        for (const auto &result : splits)
+        {
+            addTrial(result.trials[0]);
+            addTrial(result.trials[1]);
+            for (uint32_t i = 0; i < result.childCount; i++)
+            {
+                if (result.children[i].lower <= globalMin)
+                {
+                    push(result.children[i]);
+                }
+            }
+        }
+    }
+
+    m_lowerBound = std::min(globalMin, settled);
+    if (!queue.empty())
+    {
+        m_lowerBound = std::min(m_lowerBound, queue.front().lower);
+    }
+
+    if (m_observer && reported != currCount)
+    {
+        report();
+    }
+
+    *count = currCount;
+    *min = globalMin;
+    *point = currPoint;
+}
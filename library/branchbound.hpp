@@ -0,0 +1,80 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "cache.hpp"
+#include "objective.hpp"
+#include "progress.hpp"
+#include "snapshot.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Interval branch and bound. Boxes are kept in a queue ordered by the lower
+// bound of their enclosure; the best ones are bisected until narrower than
+// eps and boxes whose bound exceeds the best value found are discarded.
+// Where the derivative enclosure has one sign the box minimum is its lower
+// end, which is evaluated and the box closed.
+// The functions are called from several threads and must be thread safe.
+class BranchAndBoundMethod
+{
+public:
+    explicit BranchAndBoundMethod(uint32_t count,
+                                  double eps,
+                                  std::function<double(double)> function,
+                                  EnclosureFunction enclosure,
+                                  EnclosureFunction derivative = nullptr,
+                                  uint32_t threads = 0);
+
+    void execute(uint32_t *count, double *min, double *point, double x1, double x2);
+
+    // Observer is called every `iterations` trials, zero reports at the end only
+    void setObserver(IObserver *observer, uint32_t iterations);
+
+    void setCancellationToken(const CancellationToken *token);
+
+    // Trials look their points up in the cache first and store what they evaluate
+    void setCache(std::shared_ptr<EvaluationCache> cache);
+
+    [[nodiscard]] SearchState getState() const;
+
+    // The global minimum proven by the last execute() lies in [getLowerBound(), min]
+    [[nodiscard]] double getLowerBound() const noexcept;
+
+private:
+    struct Box
+    {
+        double x1;
+        double x2;
+        double lower;
+    };
+
+    // Result of bisecting one box: at most two children and one trial per half
+    struct Split
+    {
+        Box      children[2];
+        Trial    trials[2];
+        uint32_t childCount;
+    };
+
+    [[nodiscard]] double f(double x) const;
+
+    void split(const Box &box, Split *result) const;
+
+    void processRound(const std::vector<Box> &boxes, std::vector<Split> &splits) const;
+
+    uint32_t                      m_maxCount;
+    double                        m_eps;
+    std::function<double(double)> m_function;
+    EnclosureFunction             m_enclosure;
+    EnclosureFunction             m_derivative;
+    uint32_t                      m_threads;
+
+    IObserver                    *m_observer;
+    uint32_t                      m_reportIterations;
+    const CancellationToken      *m_token;
+    StatePublisher                m_state;
+    double                        m_lowerBound;
+
+    std::shared_ptr<EvaluationCache> m_cache;
+};
@@ -0,0 +1,321 @@
+// Copyright Lebedev Alexander 2020
+#include "cache.hpp"
+#include "storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SPPR_MMAP 1
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const uint64_t magic = 0x3130656863617073ull; // "spcache1"
+
+    // Slots probed from the home slot before a lookup gives up
+    const size_t neighbourhood = 32;
+
+    enum State : uint32_t
+    {
+        Empty,
+        Writing,
+        Ready
+    };
+
+    struct Header
+    {
+        uint64_t magic;
+        uint64_t capacity;
+    };
+
+    uint64_t hash(const std::string &text)
+    {
+        // FNV-1a
+        uint64_t value = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            value = (value ^ c) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    uint64_t mix(uint64_t value)
+    {
+        // splitmix64 finalizer
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return value ^ (value >> 31);
+    }
+
+    uint64_t bitsOf(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    double valueOf(uint64_t bits)
+    {
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+}
+
+struct EvaluationCache::Slot
+{
+    std::atomic<uint32_t> state;
+    uint32_t              reserved;
+    uint64_t              fingerprint;
+    uint64_t              x;
+    uint64_t              z;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "slots are shared between processes");
+static_assert(sizeof(Header) % alignof(std::atomic<uint32_t>) == 0, "slots follow the header");
+
+EvaluationCache::EvaluationCache(const std::string &fingerprint, const std::string &path, size_t capacity)
+        : m_fingerprint(hash(fingerprint)),
+          m_memory(nullptr),
+          m_size(0),
+          m_slots(nullptr),
+          m_capacity(0),
+          m_hits(0),
+          m_misses(0)
+{
+#ifdef SPPR_MMAP
+    namespace fs = std::filesystem;
+
+    fs::path file = path;
+    if (file.empty())
+    {
+        auto directory = getCacheDirectory();
+        if (directory.empty())
+        {
+            m_error = "no cache directory, set $SPPR_CACHE";
+            return;
+        }
+        if (!isPrivate(directory, &m_error))
+        {
+            return;
+        }
+        file = directory / "evaluations.cache";
+    }
+
+    int fd = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0)
+    {
+        m_error = "cannot open " + file.string() + ": " + std::strerror(errno);
+        return;
+    }
+
+    // Values written by others would be returned as the objective's
+    if (!isPrivate(file, &m_error))
+    {
+        close(fd);
+        return;
+    }
+
+    // The first process to get the lock lays out a new file
+    flock(fd, LOCK_EX);
+    struct stat status {};
+    Header header {};
+    if (fstat(fd, &status) == 0 && status.st_size == 0)
+    {
+        header = {magic, std::max<size_t>(capacity, neighbourhood)};
+        if (ftruncate(fd, static_cast<off_t>(sizeof(Header) + header.capacity * sizeof(Slot))) != 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            m_error = "cannot create " + file.string() + ": " + std::strerror(errno);
+        }
+    } else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != magic ||
+               header.capacity < neighbourhood ||
+               static_cast<uint64_t>(status.st_size) != sizeof(Header) + header.capacity * sizeof(Slot))
+    {
+        m_error = file.string() + " is not an evaluation cache";
+    }
+    flock(fd, LOCK_UN);
+
+    if (m_error.empty())
+    {
+        m_size = sizeof(Header) + header.capacity * sizeof(Slot);
+        m_memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (m_memory == MAP_FAILED)
+        {
+            m_error = "cannot map " + file.string() + ": " + std::strerror(errno);
+            m_memory = nullptr;
+        } else
+        {
+            m_slots = reinterpret_cast<Slot *>(static_cast<char *>(m_memory) + sizeof(Header));
+            m_capacity = header.capacity;
+        }
+    }
+    close(fd);
+#else
+    m_error = "memory mapped files are not supported on this platform";
+#endif
+}
+
+EvaluationCache::~EvaluationCache()
+{
+#ifdef SPPR_MMAP
+    if (m_memory)
+    {
+        munmap(m_memory, m_size);
+    }
+#endif
+}
+
+bool EvaluationCache::isOpen() const noexcept
+{
+    return m_slots != nullptr;
+}
+
+const std::string &EvaluationCache::getError() const noexcept
+{
+    return m_error;
+}
+
+size_t EvaluationCache::getIndex(uint64_t bits) const noexcept
+{
+    return mix(m_fingerprint ^ mix(bits)) % m_capacity;
+}
+
+bool EvaluationCache::find(double x, double *z) const
+{
+    if (!m_slots)
+    {
+        return false;
+    }
+
+    auto bits = bitsOf(x);
+    auto index = getIndex(bits);
+    for (size_t i = 0; i < neighbourhood; i++)
+    {
+        const auto &slot = m_slots[(index + i) % m_capacity];
+        auto state = slot.state.load(std::memory_order_acquire);
+        if (state == Empty)
+        {
+            return false;
+        }
+        if (state == Ready && slot.fingerprint == m_fingerprint && slot.x == bits)
+        {
+            *z = valueOf(slot.z);
+            return true;
+        }
+    }
+    return false;
+}
+
+void EvaluationCache::store(double x, double z)
+{
+    if (!m_slots || std::isnan(z))
+    {
+        return;
+    }
+
+    auto bits = bitsOf(x);
+    auto index = getIndex(bits);
+    for (size_t i = 0; i < neighbourhood; i++)
+    {
+        auto &slot = m_slots[(index + i) % m_capacity];
+        uint32_t state = Empty;
+        if (slot.state.compare_exchange_strong(state, Writing, std::memory_order_acquire))
+        {
+            slot.fingerprint = m_fingerprint;
+            slot.x = bits;
+            slot.z = bitsOf(z);
+            slot.state.store(Ready, std::memory_order_release);
+            return;
+        }
+        if (state == Ready && slot.fingerprint == m_fingerprint && slot.x == bits)
+        {
+            return;
+        }
+    }
+}
+
+double EvaluationCache::evaluate(double x, const std::function<double(double)> &function)
+{
+    double z;
+    if (find(x, &z))
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return z;
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    z = function(x);
+    store(x, z);
+    return z;
+}
+
+double EvaluationCache::evaluate(double x, double cutoff, bool *exact, const BoundedFunction &function)
+{
+    double z;
+    *exact = true;
+    if (find(x, &z))
+    {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+        return z;
+    }
+
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+    z = function(x, cutoff, exact);
+    if (*exact)
+    {
+        store(x, z);
+    }
+    return z;
+}
+
+void EvaluationCache::evaluate(const double *x, double *z, size_t count, const BatchFunction &batch)
+{
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!find(x[i], &z[i]))
+        {
+            missing.push_back(i);
+        }
+    }
+    m_hits.fetch_add(count - missing.size(), std::memory_order_relaxed);
+    m_misses.fetch_add(missing.size(), std::memory_order_relaxed);
+    if (missing.empty())
+    {
+        return;
+    }
+
+    std::vector<double> missingX(missing.size());
+    std::vector<double> missingZ(missing.size());
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        missingX[i] = x[missing[i]];
+    }
+    batch(missingX.data(), missingZ.data(), missing.size());
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        z[missing[i]] = missingZ[i];
+        store(missingX[i], missingZ[i]);
+    }
+}
+
+uint64_t EvaluationCache::getHits() const noexcept
+{
+    return m_hits.load(std::memory_order_relaxed);
+}
+
+uint64_t EvaluationCache::getMisses() const noexcept
+{
+    return m_misses.load(std::memory_order_relaxed);
+}
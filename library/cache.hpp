@@ -0,0 +1,69 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "objective.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Objective values memoized on disk across runs. The file is a memory mapped
+// open addressing table keyed by the objective fingerprint and the exact bits
+// of x, shared by every objective and by concurrent processes: slots are
+// claimed with an atomic compare and swap and published once written, so
+// readers never see a half written value. A full neighbourhood simply drops
+// the value. NaN values are not stored.
+class EvaluationCache
+{
+public:
+    // The fingerprint identifies the objective, e.g. the source of a formula.
+    // An empty path selects evaluations.cache in the per-user cache directory
+    // (see storage.hpp); the capacity only applies to a new file. The file must
+    // belong to the current user and be writable by nobody else.
+    explicit EvaluationCache(const std::string &fingerprint,
+                             const std::string &path = "",
+                             size_t capacity = size_t(1) << 20);
+
+    ~EvaluationCache();
+
+    EvaluationCache(const EvaluationCache &) = delete;
+
+    EvaluationCache &operator=(const EvaluationCache &) = delete;
+
+    [[nodiscard]] bool isOpen() const noexcept;
+
+    // Why every call is a miss, empty when the file is mapped
+    [[nodiscard]] const std::string &getError() const noexcept;
+
+    [[nodiscard]] bool find(double x, double *z) const;
+
+    void store(double x, double z);
+
+    // Looks x up and evaluates the function on a miss
+    [[nodiscard]] double evaluate(double x, const std::function<double(double)> &function);
+
+    // Only exact values are stored
+    [[nodiscard]] double evaluate(double x, double cutoff, bool *exact, const BoundedFunction &function);
+
+    // Evaluates only the points that miss, with one call of the batch function
+    void evaluate(const double *x, double *z, size_t count, const BatchFunction &batch);
+
+    [[nodiscard]] uint64_t getHits() const noexcept;
+
+    [[nodiscard]] uint64_t getMisses() const noexcept;
+
+private:
+    struct Slot;
+
+    [[nodiscard]] size_t getIndex(uint64_t bits) const noexcept;
+
+    uint64_t              m_fingerprint;
+    std::string           m_error;
+    void                 *m_memory;
+    size_t                m_size;
+    Slot                 *m_slots;
+    size_t                m_capacity;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
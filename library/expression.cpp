@@ -0,0 +1,1177 @@
+// Copyright Lebedev Alexander 2020
+#include "expression.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <tuple>
+
+namespace
+{
+    using Opcode = Expression::Opcode;
+    using Node   = Expression::Node;
+
+    constexpr uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    // Points per block of the array evaluation
+    constexpr size_t block = 64;
+
+    constexpr double pi = 3.14159265358979323846;
+    constexpr double e  = 2.71828182845904523536;
+
+    struct Function
+    {
+        const char *name;
+        Opcode      op;
+        int         arity;
+    };
+
+    const Function functions[] = {
+        {"abs", Opcode::Abs, 1},
+        {"sqrt", Opcode::Sqrt, 1},
+        {"exp", Opcode::Exp, 1},
+        {"log", Opcode::Log, 1},
+        {"ln", Opcode::Log, 1},
+        {"sin", Opcode::Sin, 1},
+        {"cos", Opcode::Cos, 1},
+        {"tan", Opcode::Tan, 1},
+        {"asin", Opcode::Asin, 1},
+        {"acos", Opcode::Acos, 1},
+        {"atan", Opcode::Atan, 1},
+        {"sinh", Opcode::Sinh, 1},
+        {"cosh", Opcode::Cosh, 1},
+        {"tanh", Opcode::Tanh, 1},
+        {"pow", Opcode::Pow, 2},
+        {"min", Opcode::Min, 2},
+        {"max", Opcode::Max, 2}
+    };
+
+    // Recursive descent over
+    //   sum     := product (('+' | '-') product)*
+    //   product := unary (('*' | '/') unary)*
+    //   unary   := ('-' | '+') unary | power
+    //   power   := primary ('^' unary)?
+    //   primary := number | name | name '(' sum (',' sum)* ')' | '(' sum ')'
+    class Parser
+    {
+    public:
+        Parser(const std::string &text,
+               const std::map<std::string, double> &parameters,
+               std::vector<Node> &nodes)
+                : m_text(text),
+                  m_parameters(parameters),
+                  m_nodes(nodes),
+                  m_position(0)
+        {
+            // Empty constructor
+        }
+
+        uint32_t parse(std::string *error)
+        {
+            auto root = sum();
+            skipSpaces();
+            if (m_error.empty() && m_position < m_text.size())
+            {
+                fail("unexpected '" + std::string(1, m_text[m_position]) + "'");
+            }
+
+            *error = m_error;
+            return m_error.empty() ? root : none;
+        }
+
+    private:
+        uint32_t add(Opcode op, uint32_t lhs = none, uint32_t rhs = none, double value = 0.)
+        {
+            m_nodes.push_back({op, lhs, rhs, value});
+            return static_cast<uint32_t>(m_nodes.size() - 1);
+        }
+
+        void fail(const std::string &message)
+        {
+            if (m_error.empty())
+            {
+                m_error = message + " at position " + std::to_string(m_position + 1);
+            }
+        }
+
+        void skipSpaces()
+        {
+            while (m_position < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_position])))
+            {
+                m_position++;
+            }
+        }
+
+        bool accept(char c)
+        {
+            skipSpaces();
+            if (m_position < m_text.size() && m_text[m_position] == c)
+            {
+                m_position++;
+                return true;
+            }
+            return false;
+        }
+
+        uint32_t sum()
+        {
+            auto lhs = product();
+            while (m_error.empty())
+            {
+                if (accept('+'))
+                {
+                    lhs = add(Opcode::Add, lhs, product());
+                } else if (accept('-'))
+                {
+                    lhs = add(Opcode::Sub, lhs, product());
+                } else
+                {
+                    break;
+                }
+            }
+            return lhs;
+        }
+
+        uint32_t product()
+        {
+            auto lhs = unary();
+            while (m_error.empty())
+            {
+                if (accept('*'))
+                {
+                    lhs = add(Opcode::Mul, lhs, unary());
+                } else if (accept('/'))
+                {
+                    lhs = add(Opcode::Div, lhs, unary());
+                } else
+                {
+                    break;
+                }
+            }
+            return lhs;
+        }
+
+        uint32_t unary()
+        {
+            if (accept('-'))
+            {
+                return add(Opcode::Neg, unary());
+            }
+            if (accept('+'))
+            {
+                return unary();
+            }
+            return power();
+        }
+
+        uint32_t power()
+        {
+            auto base = primary();
+            if (m_error.empty() && accept('^'))
+            {
+                return add(Opcode::Pow, base, unary());
+            }
+            return base;
+        }
+
+        uint32_t primary()
+        {
+            skipSpaces();
+            if (m_position >= m_text.size())
+            {
+                fail("unexpected end");
+                return none;
+            }
+
+            char c = m_text[m_position];
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '.')
+            {
+                // Unlike strtod, independent of the locale the application sets
+                const char *begin = m_text.c_str() + m_position;
+                double value = 0.;
+                auto result = std::from_chars(begin, m_text.c_str() + m_text.size(), value);
+                if (result.ec == std::errc::result_out_of_range)
+                {
+                    fail("number out of range");
+                    return none;
+                }
+                if (result.ec != std::errc() || result.ptr == begin)
+                {
+                    fail("invalid number");
+                    return none;
+                }
+                m_position += static_cast<size_t>(result.ptr - begin);
+                return add(Opcode::Const, none, none, value);
+            }
+
+            if (accept('('))
+            {
+                auto inner = sum();
+                if (m_error.empty() && !accept(')'))
+                {
+                    fail("expected ')'");
+                }
+                return inner;
+            }
+
+            if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_')
+            {
+                fail("unexpected '" + std::string(1, c) + "'");
+                return none;
+            }
+
+            auto start = m_position;
+            while (m_position < m_text.size() &&
+                   (std::isalnum(static_cast<unsigned char>(m_text[m_position])) || m_text[m_position] == '_'))
+            {
+                m_position++;
+            }
+            auto name = m_text.substr(start, m_position - start);
+
+            if (accept('('))
+            {
+                return call(name);
+            }
+            if (name == "x")
+            {
+                return add(Opcode::Var);
+            }
+
+            auto parameter = m_parameters.find(name);
+            if (parameter != m_parameters.end())
+            {
+                return add(Opcode::Const, none, none, parameter->second);
+            }
+            if (name == "pi")
+            {
+                return add(Opcode::Const, none, none, pi);
+            }
+            if (name == "e")
+            {
+                return add(Opcode::Const, none, none, e);
+            }
+
+            m_position = start;
+            fail("unknown name '" + name + "'");
+            return none;
+        }
+
+        uint32_t call(const std::string &name)
+        {
+            auto function = std::find_if(std::begin(functions), std::end(functions), [&name] (const Function &f) {
+                return name == f.name;
+            });
+            if (function == std::end(functions))
+            {
+                fail("unknown function '" + name + "'");
+                return none;
+            }
+
+            uint32_t arguments[2] = {none, none};
+            for (int i = 0; i < function->arity && m_error.empty(); i++)
+            {
+                if (i > 0 && !accept(','))
+                {
+                    fail("expected ','");
+                }
+                arguments[i] = sum();
+            }
+            if (m_error.empty() && !accept(')'))
+            {
+                fail("expected ')'");
+            }
+
+            return add(function->op, arguments[0], arguments[1]);
+        }
+
+        const std::string                   &m_text;
+        const std::map<std::string, double> &m_parameters;
+        std::vector<Node>                   &m_nodes;
+        size_t                               m_position;
+        std::string                          m_error;
+    };
+
+    inline bool isLeaf(Opcode op)
+    {
+        return op == Opcode::Const || op == Opcode::Var;
+    }
+
+    inline double apply(Opcode op, double a, double b)
+    {
+        switch (op)
+        {
+        case Opcode::Add:  return a + b;
+        case Opcode::Sub:  return a - b;
+        case Opcode::Mul:  return a * b;
+        case Opcode::Div:  return a / b;
+        case Opcode::Pow:  return std::pow(a, b);
+        case Opcode::Min:  return std::min(a, b);
+        case Opcode::Max:  return std::max(a, b);
+        case Opcode::Neg:  return -a;
+        case Opcode::Abs:  return std::fabs(a);
+        case Opcode::Sqrt: return std::sqrt(a);
+        case Opcode::Exp:  return std::exp(a);
+        case Opcode::Log:  return std::log(a);
+        case Opcode::Sin:  return std::sin(a);
+        case Opcode::Cos:  return std::cos(a);
+        case Opcode::Tan:  return std::tan(a);
+        case Opcode::Asin: return std::asin(a);
+        case Opcode::Acos: return std::acos(a);
+        case Opcode::Atan: return std::atan(a);
+        case Opcode::Sinh: return std::sinh(a);
+        case Opcode::Cosh: return std::cosh(a);
+        case Opcode::Tanh: return std::tanh(a);
+        case Opcode::Const:
+        case Opcode::Var:
+        case Opcode::SinCos:
+            break;
+        }
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // Both calls on one argument, which compilers merge into a single sincos
+    inline void sinCos(double a, double *s, double *c)
+    {
+        *s = std::sin(a);
+        *c = std::cos(a);
+    }
+
+    // Value and derivative of one instruction given its operands and their
+    // derivatives; kinks of abs, min and max take the left branch
+    inline void dual(Opcode op, double a, double da, double b, double db, double *v, double *dv)
+    {
+        switch (op)
+        {
+        case Opcode::Add:  *v = a + b; *dv = da + db; break;
+        case Opcode::Sub:  *v = a - b; *dv = da - db; break;
+        case Opcode::Mul:  *v = a * b; *dv = da * b + a * db; break;
+        case Opcode::Div:  *v = a / b; *dv = (da - *v * db) / b; break;
+        case Opcode::Pow:
+            *v = std::pow(a, b);
+            if (db == 0.)
+            {
+                *dv = da == 0. ? 0. : b * std::pow(a, b - 1.) * da;
+            } else
+            {
+                *dv = *v * (db * std::log(a) + (da == 0. ? 0. : b * da / a));
+            }
+            break;
+        case Opcode::Min:  *v = std::min(a, b); *dv = b < a ? db : da; break;
+        case Opcode::Max:  *v = std::max(a, b); *dv = a < b ? db : da; break;
+        case Opcode::Neg:  *v = -a; *dv = -da; break;
+        case Opcode::Abs:  *v = std::fabs(a); *dv = a < 0. ? -da : da; break;
+        case Opcode::Sqrt: *v = std::sqrt(a); *dv = da / (2. * *v); break;
+        case Opcode::Exp:  *v = std::exp(a); *dv = *v * da; break;
+        case Opcode::Log:  *v = std::log(a); *dv = da / a; break;
+        case Opcode::Sin:
+        {
+            double c;
+            sinCos(a, v, &c);
+            *dv = c * da;
+            break;
+        }
+        case Opcode::Cos:
+        {
+            double s;
+            sinCos(a, &s, v);
+            *dv = -s * da;
+            break;
+        }
+        case Opcode::Tan:  *v = std::tan(a); *dv = (1. + *v * *v) * da; break;
+        case Opcode::Asin: *v = std::asin(a); *dv = da / std::sqrt(1. - a * a); break;
+        case Opcode::Acos: *v = std::acos(a); *dv = -da / std::sqrt(1. - a * a); break;
+        case Opcode::Atan: *v = std::atan(a); *dv = da / (1. + a * a); break;
+        case Opcode::Sinh: *v = std::sinh(a); *dv = std::cosh(a) * da; break;
+        case Opcode::Cosh: *v = std::cosh(a); *dv = std::sinh(a) * da; break;
+        case Opcode::Tanh: *v = std::tanh(a); *dv = (1. - *v * *v) * da; break;
+        case Opcode::Const:
+        case Opcode::Var:
+        case Opcode::SinCos:
+            break;
+        }
+    }
+
+    // SinCos over dual numbers, its sine goes to s and its cosine to c
+    inline void dualSinCos(double a, double da, double *s, double *ds, double *c, double *dc)
+    {
+        sinCos(a, s, c);
+        *ds = *c * da;
+        *dc = -*s * da;
+    }
+
+    inline Interval applyInterval(Opcode op, const Interval &a, const Interval &b)
+    {
+        switch (op)
+        {
+        case Opcode::Add:  return a + b;
+        case Opcode::Sub:  return a - b;
+        case Opcode::Mul:  return a * b;
+        case Opcode::Div:  return a / b;
+        case Opcode::Pow:  return pow(a, b);
+        case Opcode::Min:  return min(a, b);
+        case Opcode::Max:  return max(a, b);
+        case Opcode::Neg:  return -a;
+        case Opcode::Abs:  return abs(a);
+        case Opcode::Sqrt: return sqrt(a);
+        case Opcode::Exp:  return exp(a);
+        case Opcode::Log:  return log(a);
+        case Opcode::Sin:  return sin(a);
+        case Opcode::Cos:  return cos(a);
+        case Opcode::Tan:  return tan(a);
+        case Opcode::Asin: return asin(a);
+        case Opcode::Acos: return acos(a);
+        case Opcode::Atan: return atan(a);
+        case Opcode::Sinh: return sinh(a);
+        case Opcode::Cosh: return cosh(a);
+        case Opcode::Tanh: return tanh(a);
+        case Opcode::Const:
+        case Opcode::Var:
+        case Opcode::SinCos:
+            break;
+        }
+        return Interval::whole();
+    }
+
+    // Interval counterpart of dual(): where the branch of abs, min or max is
+    // not decided over the operands both derivatives are covered
+    inline void dualInterval(Opcode op, const Interval &a, const Interval &da, const Interval &b, const Interval &db,
+                             Interval *v, Interval *dv)
+    {
+        const Interval one = {1., 1.};
+        *v = applyInterval(op, a, b);
+        switch (op)
+        {
+        case Opcode::Add:  *dv = da + db; break;
+        case Opcode::Sub:  *dv = da - db; break;
+        case Opcode::Mul:  *dv = da * b + a * db; break;
+        case Opcode::Div:  *dv = (da - *v * db) / b; break;
+        case Opcode::Pow:
+            if (db.lo == 0. && db.hi == 0.)
+            {
+                // An integer exponent stays an integer, so pow() keeps its sign rules
+                bool integer = b.isPoint() && std::nearbyint(b.lo) == b.lo;
+                auto exponent = integer ? Interval{b.lo - 1., b.lo - 1.} : b - one;
+                *dv = b * pow(a, exponent) * da;
+            } else
+            {
+                *dv = *v * (db * log(a) + b * da / a);
+            }
+            break;
+        case Opcode::Min:  *dv = a.hi < b.lo ? da : b.hi < a.lo ? db : hull(da, db); break;
+        case Opcode::Max:  *dv = a.lo > b.hi ? da : b.lo > a.hi ? db : hull(da, db); break;
+        case Opcode::Neg:  *dv = -da; break;
+        case Opcode::Abs:  *dv = a.lo > 0. ? da : a.hi < 0. ? -da : hull(da, -da); break;
+        case Opcode::Sqrt: *dv = da / (Interval{2., 2.} * *v); break;
+        case Opcode::Exp:  *dv = *v * da; break;
+        case Opcode::Log:  *dv = da / a; break;
+        case Opcode::Sin:  *dv = cos(a) * da; break;
+        case Opcode::Cos:  *dv = -(sin(a) * da); break;
+        case Opcode::Tan:  *dv = (one + sqr(*v)) * da; break;
+        case Opcode::Asin: *dv = da / sqrt(one - sqr(a)); break;
+        case Opcode::Acos: *dv = -(da / sqrt(one - sqr(a))); break;
+        case Opcode::Atan: *dv = da / (one + sqr(a)); break;
+        case Opcode::Sinh: *dv = cosh(a) * da; break;
+        case Opcode::Cosh: *dv = sinh(a) * da; break;
+        case Opcode::Tanh: *dv = (one - sqr(*v)) * da; break;
+        case Opcode::Const:
+        case Opcode::Var:
+        case Opcode::SinCos:
+            break;
+        }
+    }
+
+    // Rebuilds the DAG bottom-up, every node passes through add(), which
+    // returns an existing equal node instead of creating a duplicate
+    class Optimizer
+    {
+    public:
+        explicit Optimizer(std::vector<Node> &nodes)
+                : m_nodes(nodes)
+        {
+            // Empty constructor
+        }
+
+        uint32_t add(Node node)
+        {
+            if (isLeaf(node.op))
+            {
+                return share(node);
+            }
+
+            const auto &a = m_nodes[node.lhs];
+            bool unary = node.rhs == none;
+            if (a.op == Opcode::Const && (unary || m_nodes[node.rhs].op == Opcode::Const))
+            {
+                double b = unary ? 0. : m_nodes[node.rhs].value;
+                return share({Opcode::Const, none, none, apply(node.op, a.value, b)});
+            }
+
+            switch (node.op)
+            {
+            case Opcode::Add:
+                if (isConstant(node.rhs, -0.))
+                {
+                    return node.lhs;
+                }
+                if (isConstant(node.lhs, -0.))
+                {
+                    return node.rhs;
+                }
+                if (m_nodes[node.rhs].op == Opcode::Neg)
+                {
+                    return add({Opcode::Sub, node.lhs, m_nodes[node.rhs].lhs, 0.});
+                }
+                if (a.op == Opcode::Neg)
+                {
+                    return add({Opcode::Sub, node.rhs, a.lhs, 0.});
+                }
+                break;
+            case Opcode::Sub:
+                if (isConstant(node.rhs, 0.))
+                {
+                    return node.lhs;
+                }
+                if (m_nodes[node.rhs].op == Opcode::Neg)
+                {
+                    return add({Opcode::Add, node.lhs, m_nodes[node.rhs].lhs, 0.});
+                }
+                break;
+            case Opcode::Mul:
+                for (auto [factor, other] : {std::make_pair(node.lhs, node.rhs), std::make_pair(node.rhs, node.lhs)})
+                {
+                    if (isConstant(factor, 1.))
+                    {
+                        return other;
+                    }
+                    if (isConstant(factor, -1.))
+                    {
+                        return add({Opcode::Neg, other, none, 0.});
+                    }
+                }
+                break;
+            case Opcode::Div:
+                if (isConstant(node.rhs, 1.))
+                {
+                    return node.lhs;
+                }
+                if (isConstant(node.rhs, -1.))
+                {
+                    return add({Opcode::Neg, node.lhs, none, 0.});
+                }
+                break;
+            case Opcode::Pow:
+                if (isConstant(node.rhs, 1.))
+                {
+                    return node.lhs;
+                }
+                if (isConstant(node.rhs, 2.))
+                {
+                    return add({Opcode::Mul, node.lhs, node.lhs, 0.});
+                }
+                break;
+            case Opcode::Neg:
+                if (a.op == Opcode::Neg)
+                {
+                    return a.lhs;
+                }
+                break;
+            case Opcode::Abs:
+                if (a.op == Opcode::Neg || a.op == Opcode::Abs)
+                {
+                    return add({Opcode::Abs, a.lhs, none, 0.});
+                }
+                break;
+            default:
+                break;
+            }
+
+            // Addition and multiplication commute exactly, a canonical operand
+            // order lets a*b and b*a share one node
+            if ((node.op == Opcode::Add || node.op == Opcode::Mul) && node.lhs > node.rhs)
+            {
+                std::swap(node.lhs, node.rhs);
+            }
+            return share(node);
+        }
+
+    private:
+        bool isConstant(uint32_t index, double value) const
+        {
+            const auto &node = m_nodes[index];
+            return node.op == Opcode::Const && std::memcmp(&node.value, &value, sizeof(double)) == 0;
+        }
+
+        uint32_t share(const Node &node)
+        {
+            uint64_t bits = 0;
+            std::memcpy(&bits, &node.value, sizeof(double));
+            auto key = std::make_tuple(node.op, node.lhs, node.rhs, bits);
+
+            auto existing = m_known.find(key);
+            if (existing != m_known.end())
+            {
+                return existing->second;
+            }
+
+            m_nodes.push_back(node);
+            auto index = static_cast<uint32_t>(m_nodes.size() - 1);
+            m_known.emplace(key, index);
+            return index;
+        }
+
+        std::vector<Node>                                                  &m_nodes;
+        std::map<std::tuple<Opcode, uint32_t, uint32_t, uint64_t>, uint32_t> m_known;
+    };
+}
+
+Expression::Expression(const std::string &text,
+                       const std::map<std::string, double> &parameters,
+                       bool optimize)
+        : m_root(none),
+          m_variable(0),
+          m_result(0),
+          m_registers(0)
+{
+    Parser parser(text, parameters, m_nodes);
+    m_root = parser.parse(&m_error);
+
+    if (isValid())
+    {
+        if (optimize)
+        {
+            this->optimize();
+        }
+        compile();
+    }
+}
+
+bool Expression::isValid() const noexcept
+{
+    return m_root != none;
+}
+
+const std::string &Expression::getError() const noexcept
+{
+    return m_error;
+}
+
+const std::vector<Expression::Node> &Expression::getNodes() const noexcept
+{
+    return m_nodes;
+}
+
+const std::vector<Expression::Instruction> &Expression::getCode() const noexcept
+{
+    return m_code;
+}
+
+uint32_t Expression::getRegisterCount() const noexcept
+{
+    return m_registers;
+}
+
+const std::vector<double> &Expression::getConstants() const noexcept
+{
+    return m_constants;
+}
+
+uint32_t Expression::getVariableRegister() const noexcept
+{
+    return m_variable;
+}
+
+uint32_t Expression::getResultRegister() const noexcept
+{
+    return m_result;
+}
+
+void Expression::optimize()
+{
+    std::vector<Node> nodes;
+    Optimizer optimizer(nodes);
+
+    std::vector<uint32_t> mapping(m_nodes.size(), none);
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        auto node = m_nodes[i];
+        if (node.lhs != none)
+        {
+            node.lhs = mapping[node.lhs];
+        }
+        if (node.rhs != none)
+        {
+            node.rhs = mapping[node.rhs];
+        }
+        mapping[i] = optimizer.add(node);
+    }
+
+    m_root = mapping[m_root];
+    m_nodes.swap(nodes);
+}
+
+void Expression::compile()
+{
+    // Children always precede their parents, so a backward sweep finds the
+    // nodes reachable from the root and how often each one is read
+    std::vector<uint32_t> uses(m_nodes.size(), 0);
+    std::vector<char> reachable(m_nodes.size(), 0);
+    reachable[m_root] = 1;
+    for (size_t i = m_nodes.size(); i-- > 0;)
+    {
+        if (!reachable[i])
+        {
+            continue;
+        }
+        for (auto child : {m_nodes[i].lhs, m_nodes[i].rhs})
+        {
+            if (child != none)
+            {
+                reachable[child] = 1;
+                uses[child]++;
+            }
+        }
+    }
+
+    // sin and cos of the same argument are computed by one SinCos instruction,
+    // emitted where the first of the two nodes is
+    std::vector<uint32_t> partners(m_nodes.size(), none);
+    std::map<uint32_t, uint32_t> sines;
+    std::map<uint32_t, uint32_t> cosines;
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        if (reachable[i] && m_nodes[i].op == Opcode::Sin)
+        {
+            sines[m_nodes[i].lhs] = static_cast<uint32_t>(i);
+        } else if (reachable[i] && m_nodes[i].op == Opcode::Cos)
+        {
+            cosines[m_nodes[i].lhs] = static_cast<uint32_t>(i);
+        }
+    }
+    for (const auto &sine : sines)
+    {
+        auto cosine = cosines.find(sine.first);
+        if (cosine != cosines.end())
+        {
+            partners[sine.second] = cosine->second;
+            partners[cosine->second] = sine.second;
+        }
+    }
+
+    // Constants come first in the register file, followed by x and the temporaries
+    std::vector<uint32_t> registers(m_nodes.size(), none);
+    m_constants.clear();
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        if (!reachable[i] || m_nodes[i].op != Opcode::Const)
+        {
+            continue;
+        }
+
+        auto value = m_nodes[i].value;
+        auto existing = std::find_if(m_constants.begin(), m_constants.end(), [value] (double constant) {
+            return std::memcmp(&constant, &value, sizeof(double)) == 0;
+        });
+        registers[i] = static_cast<uint32_t>(existing - m_constants.begin());
+        if (existing == m_constants.end())
+        {
+            m_constants.push_back(value);
+        }
+    }
+    m_variable = static_cast<uint32_t>(m_constants.size());
+    m_registers = m_variable + 1;
+
+    // Temporaries are recycled as soon as their last reader has executed
+    std::vector<uint32_t> free;
+    auto release = [this, &uses, &registers, &free] (uint32_t child) {
+        if (child != none && !isLeaf(m_nodes[child].op) && --uses[child] == 0)
+        {
+            free.push_back(registers[child]);
+        }
+    };
+    auto allocate = [this, &free] () {
+        if (free.empty())
+        {
+            return m_registers++;
+        }
+        auto index = free.back();
+        free.pop_back();
+        return index;
+    };
+
+    m_code.clear();
+    for (size_t i = 0; i < m_nodes.size(); i++)
+    {
+        const auto &node = m_nodes[i];
+        if (!reachable[i] || node.op == Opcode::Const || registers[i] != none)
+        {
+            continue;
+        }
+        if (node.op == Opcode::Var)
+        {
+            registers[i] = m_variable;
+            continue;
+        }
+
+        auto partner = partners[i];
+        if (partner != none)
+        {
+            auto sine = node.op == Opcode::Sin ? static_cast<uint32_t>(i) : partner;
+            auto cosine = node.op == Opcode::Sin ? partner : static_cast<uint32_t>(i);
+            auto argument = registers[node.lhs];
+            release(node.lhs);
+            release(node.lhs);
+            registers[sine] = allocate();
+            registers[cosine] = allocate();
+            m_code.push_back({Opcode::SinCos, registers[sine], argument, registers[cosine]});
+            continue;
+        }
+
+        Instruction instruction = {node.op, 0, registers[node.lhs], node.rhs != none ? registers[node.rhs] : 0};
+        release(node.lhs);
+        release(node.rhs);
+        registers[i] = allocate();
+
+        instruction.dst = registers[i];
+        m_code.push_back(instruction);
+    }
+
+    m_result = registers[m_root];
+}
+
+double Expression::evaluate(double x) const
+{
+    if (!isValid())
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    constexpr uint32_t stackRegisters = 64;
+    double stack[stackRegisters];
+    std::vector<double> heap;
+    double *r = stack;
+    if (m_registers > stackRegisters)
+    {
+        heap.resize(m_registers);
+        r = heap.data();
+    }
+
+    std::copy(m_constants.begin(), m_constants.end(), r);
+    r[m_variable] = x;
+
+    for (const auto &instruction : m_code)
+    {
+        auto a = r[instruction.lhs];
+        if (instruction.op == Opcode::SinCos)
+        {
+            sinCos(a, &r[instruction.dst], &r[instruction.rhs]);
+        } else
+        {
+            r[instruction.dst] = apply(instruction.op, a, r[instruction.rhs]);
+        }
+    }
+
+    return r[m_result];
+}
+
+void Expression::evaluate(const double *x, double *z, size_t count) const
+{
+    if (!isValid())
+    {
+        std::fill(z, z + count, std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+
+    constexpr uint32_t stackRegisters = 32;
+    alignas(64) double stack[stackRegisters * block];
+    std::vector<double> heap;
+    double *r = stack;
+    if (m_registers > stackRegisters)
+    {
+        heap.resize(static_cast<size_t>(m_registers) * block);
+        r = heap.data();
+    }
+
+    for (size_t i = 0; i < m_constants.size(); i++)
+    {
+        std::fill(r + i * block, r + (i + 1) * block, m_constants[i]);
+    }
+
+    for (size_t begin = 0; begin < count; begin += block)
+    {
+        evaluateBlock(x + begin, z + begin, std::min(block, count - begin), r);
+    }
+}
+
+void Expression::evaluateBlock(const double *x, double *z, size_t count, double *r) const
+{
+    std::copy(x, x + count, r + m_variable * block);
+
+    for (const auto &instruction : m_code)
+    {
+        const double *a = r + instruction.lhs * block;
+        const double *b = r + instruction.rhs * block;
+        double *dst = r + instruction.dst * block;
+
+        switch (instruction.op)
+        {
+        case Opcode::Add:  for (size_t i = 0; i < count; i++) dst[i] = a[i] + b[i]; break;
+        case Opcode::Sub:  for (size_t i = 0; i < count; i++) dst[i] = a[i] - b[i]; break;
+        case Opcode::Mul:  for (size_t i = 0; i < count; i++) dst[i] = a[i] * b[i]; break;
+        case Opcode::Div:  for (size_t i = 0; i < count; i++) dst[i] = a[i] / b[i]; break;
+        case Opcode::Pow:  for (size_t i = 0; i < count; i++) dst[i] = std::pow(a[i], b[i]); break;
+        case Opcode::Min:  for (size_t i = 0; i < count; i++) dst[i] = std::min(a[i], b[i]); break;
+        case Opcode::Max:  for (size_t i = 0; i < count; i++) dst[i] = std::max(a[i], b[i]); break;
+        case Opcode::Neg:  for (size_t i = 0; i < count; i++) dst[i] = -a[i]; break;
+        case Opcode::Abs:  for (size_t i = 0; i < count; i++) dst[i] = std::fabs(a[i]); break;
+        case Opcode::Sqrt: for (size_t i = 0; i < count; i++) dst[i] = std::sqrt(a[i]); break;
+        case Opcode::Exp:  for (size_t i = 0; i < count; i++) dst[i] = std::exp(a[i]); break;
+        case Opcode::Log:  for (size_t i = 0; i < count; i++) dst[i] = std::log(a[i]); break;
+        case Opcode::Sin:  for (size_t i = 0; i < count; i++) dst[i] = std::sin(a[i]); break;
+        case Opcode::Cos:  for (size_t i = 0; i < count; i++) dst[i] = std::cos(a[i]); break;
+        case Opcode::Tan:  for (size_t i = 0; i < count; i++) dst[i] = std::tan(a[i]); break;
+        case Opcode::Asin: for (size_t i = 0; i < count; i++) dst[i] = std::asin(a[i]); break;
+        case Opcode::Acos: for (size_t i = 0; i < count; i++) dst[i] = std::acos(a[i]); break;
+        case Opcode::Atan: for (size_t i = 0; i < count; i++) dst[i] = std::atan(a[i]); break;
+        case Opcode::Sinh: for (size_t i = 0; i < count; i++) dst[i] = std::sinh(a[i]); break;
+        case Opcode::Cosh: for (size_t i = 0; i < count; i++) dst[i] = std::cosh(a[i]); break;
+        case Opcode::Tanh: for (size_t i = 0; i < count; i++) dst[i] = std::tanh(a[i]); break;
+        case Opcode::SinCos:
+        {
+            // b is the cosine destination here
+            auto *cosine = r + instruction.rhs * block;
+            for (size_t i = 0; i < count; i++) sinCos(a[i], dst + i, cosine + i);
+            break;
+        }
+        case Opcode::Const:
+        case Opcode::Var:
+            break;
+        }
+    }
+
+    std::copy(r + m_result * block, r + m_result * block + count, z);
+}
+
+double Expression::evaluateDerivative(double x, double *derivative) const
+{
+    if (!isValid())
+    {
+        *derivative = std::numeric_limits<double>::quiet_NaN();
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    constexpr uint32_t stackRegisters = 64;
+    double stack[2 * stackRegisters];
+    std::vector<double> heap;
+    double *r = stack;
+    if (m_registers > stackRegisters)
+    {
+        heap.resize(2 * static_cast<size_t>(m_registers));
+        r = heap.data();
+    }
+    double *d = r + std::max(m_registers, stackRegisters);
+
+    std::copy(m_constants.begin(), m_constants.end(), r);
+    std::fill(d, d + m_constants.size(), 0.);
+    r[m_variable] = x;
+    d[m_variable] = 1.;
+
+    for (const auto &instruction : m_code)
+    {
+        auto a = r[instruction.lhs];
+        auto da = d[instruction.lhs];
+        if (instruction.op == Opcode::SinCos)
+        {
+            dualSinCos(a, da, &r[instruction.dst], &d[instruction.dst], &r[instruction.rhs], &d[instruction.rhs]);
+        } else
+        {
+            dual(instruction.op, a, da, r[instruction.rhs], d[instruction.rhs], &r[instruction.dst], &d[instruction.dst]);
+        }
+    }
+
+    *derivative = d[m_result];
+    return r[m_result];
+}
+
+void Expression::evaluateDerivative(const double *x, double *z, double *dz, size_t count) const
+{
+    if (!isValid())
+    {
+        std::fill(z, z + count, std::numeric_limits<double>::quiet_NaN());
+        std::fill(dz, dz + count, std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+
+    constexpr uint32_t stackRegisters = 16;
+    alignas(64) double stack[2 * stackRegisters * block];
+    std::vector<double> heap;
+    double *r = stack;
+    size_t size = static_cast<size_t>(std::max(m_registers, stackRegisters)) * block;
+    if (m_registers > stackRegisters)
+    {
+        heap.resize(2 * size);
+        r = heap.data();
+    }
+    double *d = r + size;
+
+    for (size_t i = 0; i < m_constants.size(); i++)
+    {
+        std::fill(r + i * block, r + (i + 1) * block, m_constants[i]);
+        std::fill(d + i * block, d + (i + 1) * block, 0.);
+    }
+    std::fill(d + m_variable * block, d + (m_variable + 1) * block, 1.);
+
+    for (size_t begin = 0; begin < count; begin += block)
+    {
+        evaluateDerivativeBlock(x + begin, z + begin, dz + begin, std::min(block, count - begin), r, d);
+    }
+}
+
+void Expression::evaluateDerivativeBlock(const double *x, double *z, double *dz, size_t count,
+                                         double *r, double *d) const
+{
+    std::copy(x, x + count, r + m_variable * block);
+
+    for (const auto &instruction : m_code)
+    {
+        const double *a = r + instruction.lhs * block;
+        const double *da = d + instruction.lhs * block;
+        const double *b = r + instruction.rhs * block;
+        const double *db = d + instruction.rhs * block;
+        double *dst = r + instruction.dst * block;
+        double *ddst = d + instruction.dst * block;
+
+        // The opcode is a constant in every case, so dual() reduces to its branch
+        switch (instruction.op)
+        {
+        case Opcode::Add:  for (size_t i = 0; i < count; i++) dual(Opcode::Add, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Sub:  for (size_t i = 0; i < count; i++) dual(Opcode::Sub, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Mul:  for (size_t i = 0; i < count; i++) dual(Opcode::Mul, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Div:  for (size_t i = 0; i < count; i++) dual(Opcode::Div, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Pow:  for (size_t i = 0; i < count; i++) dual(Opcode::Pow, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Min:  for (size_t i = 0; i < count; i++) dual(Opcode::Min, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Max:  for (size_t i = 0; i < count; i++) dual(Opcode::Max, a[i], da[i], b[i], db[i], dst + i, ddst + i); break;
+        case Opcode::Neg:  for (size_t i = 0; i < count; i++) dual(Opcode::Neg, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Abs:  for (size_t i = 0; i < count; i++) dual(Opcode::Abs, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Sqrt: for (size_t i = 0; i < count; i++) dual(Opcode::Sqrt, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Exp:  for (size_t i = 0; i < count; i++) dual(Opcode::Exp, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Log:  for (size_t i = 0; i < count; i++) dual(Opcode::Log, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Sin:  for (size_t i = 0; i < count; i++) dual(Opcode::Sin, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Cos:  for (size_t i = 0; i < count; i++) dual(Opcode::Cos, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Tan:  for (size_t i = 0; i < count; i++) dual(Opcode::Tan, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Asin: for (size_t i = 0; i < count; i++) dual(Opcode::Asin, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Acos: for (size_t i = 0; i < count; i++) dual(Opcode::Acos, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Atan: for (size_t i = 0; i < count; i++) dual(Opcode::Atan, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Sinh: for (size_t i = 0; i < count; i++) dual(Opcode::Sinh, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Cosh: for (size_t i = 0; i < count; i++) dual(Opcode::Cosh, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::Tanh: for (size_t i = 0; i < count; i++) dual(Opcode::Tanh, a[i], da[i], 0., 0., dst + i, ddst + i); break;
+        case Opcode::SinCos:
+        {
+            auto *cosine = r + instruction.rhs * block;
+            auto *dcosine = d + instruction.rhs * block;
+            for (size_t i = 0; i < count; i++) dualSinCos(a[i], da[i], dst + i, ddst + i, cosine + i, dcosine + i);
+            break;
+        }
+        case Opcode::Const:
+        case Opcode::Var:
+            break;
+        }
+    }
+
+    std::copy(r + m_result * block, r + m_result * block + count, z);
+    std::copy(d + m_result * block, d + m_result * block + count, dz);
+}
+
+Interval Expression::enclose(const Interval &x, IntervalForm form) const
+{
+    if (form == IntervalForm::Natural || x.isPoint())
+    {
+        return evaluateInterval(x, nullptr);
+    }
+
+    Interval derivative;
+    auto natural = evaluateInterval(x, &derivative);
+
+    auto c = x.mid();
+    auto centered = evaluateInterval({c, c}, nullptr) + derivative * (x - Interval{c, c});
+    if (centered.hi < natural.lo || natural.hi < centered.lo)
+    {
+        return natural;
+    }
+    return intersect(natural, centered);
+}
+
+Interval Expression::encloseDerivative(const Interval &x) const
+{
+    Interval derivative;
+    evaluateInterval(x, &derivative);
+    return derivative;
+}
+
+Interval Expression::evaluateInterval(const Interval &x, Interval *derivative) const
+{
+    if (!isValid())
+    {
+        if (derivative)
+        {
+            *derivative = Interval::whole();
+        }
+        return Interval::whole();
+    }
+
+    std::vector<Interval> r(m_registers);
+    std::vector<Interval> d(derivative ? m_registers : 0);
+    for (size_t i = 0; i < m_constants.size(); i++)
+    {
+        r[i] = {m_constants[i], m_constants[i]};
+    }
+    r[m_variable] = x;
+    if (derivative)
+    {
+        std::fill(d.begin(), d.begin() + m_variable, Interval{0., 0.});
+        d[m_variable] = {1., 1.};
+    }
+
+    for (const auto &instruction : m_code)
+    {
+        auto a = r[instruction.lhs];
+        auto b = r[instruction.rhs];
+        auto da = derivative ? d[instruction.lhs] : Interval{0., 0.};
+        auto db = derivative ? d[instruction.rhs] : Interval{0., 0.};
+        auto &v = r[instruction.dst];
+        auto &dv = derivative ? d[instruction.dst] : da;
+
+        if (instruction.op == Opcode::SinCos)
+        {
+            auto s = sin(a);
+            auto c = cos(a);
+            v = s;
+            dv = c * da;
+            r[instruction.rhs] = c;
+            if (derivative)
+            {
+                d[instruction.rhs] = -(s * da);
+            }
+        } else if (instruction.op == Opcode::Mul && instruction.lhs == instruction.rhs)
+        {
+            // x^2 becomes x*x, a square is never negative
+            v = sqr(a);
+            dv = Interval{2., 2.} * a * da;
+        } else if (derivative)
+        {
+            dualInterval(instruction.op, a, da, b, db, &v, &dv);
+        } else
+        {
+            v = applyInterval(instruction.op, a, b);
+        }
+    }
+
+    if (derivative)
+    {
+        *derivative = d[m_result];
+    }
+    return r[m_result];
+}
@@ -0,0 +1,129 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "interval.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Objective given as a formula of x, e.g. "a*sin(b*x) + c*cos(d*x)".
+// The formula is parsed into a DAG, optimized and compiled to register
+// bytecode, which is evaluated by a switch loop without allocations or
+// virtual calls.
+class Expression
+{
+public:
+    enum class Opcode : uint8_t
+    {
+        Const,
+        Var,
+        Add,
+        Sub,
+        Mul,
+        Div,
+        Pow,
+        Min,
+        Max,
+        Neg,
+        Abs,
+        Sqrt,
+        Exp,
+        Log,
+        Sin,
+        Cos,
+        Tan,
+        Asin,
+        Acos,
+        Atan,
+        Sinh,
+        Cosh,
+        Tanh,
+        // Bytecode only: writes sin to dst and cos to the register in rhs
+        SinCos
+    };
+
+    struct Node
+    {
+        Opcode   op;
+        uint32_t lhs;
+        uint32_t rhs;
+        double   value;
+    };
+
+    struct Instruction
+    {
+        Opcode   op;
+        uint32_t dst;
+        uint32_t lhs;
+        uint32_t rhs;
+    };
+
+    // Parameters are bound at construction, names other than x and the
+    // functions resolve to them
+    explicit Expression(const std::string &text,
+                        const std::map<std::string, double> &parameters = {},
+                        bool optimize = true);
+
+    [[nodiscard]] bool isValid() const noexcept;
+
+    [[nodiscard]] const std::string &getError() const noexcept;
+
+    [[nodiscard]] double evaluate(double x) const;
+
+    // Runs each instruction over a block of points before moving to the next
+    // one, so dispatch is paid once per block and simple ops vectorize
+    void evaluate(const double *x, double *z, size_t count) const;
+
+    double operator()(double x) const { return evaluate(x); }
+
+    // Forward-mode differentiation: the same bytecode runs over dual numbers,
+    // every register carries its derivative with respect to x
+    [[nodiscard]] double evaluateDerivative(double x, double *derivative) const;
+
+    void evaluateDerivative(const double *x, double *z, double *dz, size_t count) const;
+
+    // Guaranteed enclosure of F over x, the constants are taken as they are stored
+    [[nodiscard]] Interval enclose(const Interval &x, IntervalForm form = IntervalForm::Centered) const;
+
+    // Guaranteed enclosure of F' over x
+    [[nodiscard]] Interval encloseDerivative(const Interval &x) const;
+
+    [[nodiscard]] const std::vector<Node> &getNodes() const noexcept;
+
+    [[nodiscard]] const std::vector<Instruction> &getCode() const noexcept;
+
+    [[nodiscard]] uint32_t getRegisterCount() const noexcept;
+
+    // Values the first registers hold before the code runs
+    [[nodiscard]] const std::vector<double> &getConstants() const noexcept;
+
+    [[nodiscard]] uint32_t getVariableRegister() const noexcept;
+
+    [[nodiscard]] uint32_t getResultRegister() const noexcept;
+
+private:
+    // Folds constants, shares equal subexpressions and applies the algebraic
+    // identities that are exact in floating point
+    void optimize();
+
+    void compile();
+
+    void evaluateBlock(const double *x, double *z, size_t count, double *r) const;
+
+    void evaluateDerivativeBlock(const double *x, double *z, double *dz, size_t count, double *r, double *d) const;
+
+    // Natural interval extension, with the derivative enclosure when it is not null
+    Interval evaluateInterval(const Interval &x, Interval *derivative) const;
+
+    std::vector<Node>        m_nodes;
+    uint32_t                 m_root;
+    std::string              m_error;
+
+    std::vector<Instruction> m_code;
+    std::vector<double>      m_constants;
+    uint32_t                 m_variable;
+    uint32_t                 m_result;
+    uint32_t                 m_registers;
+};
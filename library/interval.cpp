@@ -0,0 +1,273 @@
+// Copyright Lebedev Alexander 2020
+#include "interval.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+
+    constexpr double pi = 3.14159265358979323846;
+
+    // Rounded-to-nearest arithmetic is within half an ulp of the exact result
+    inline double down(double x)
+    {
+        return std::nextafter(x, -infinity);
+    }
+
+    inline double up(double x)
+    {
+        return std::nextafter(x, infinity);
+    }
+
+    // libm is not correctly rounded, two ulps cover its error on common platforms
+    inline Interval widen(double lo, double hi)
+    {
+        return {down(down(lo)), up(up(hi))};
+    }
+
+    inline Interval checked(const Interval &a)
+    {
+        return std::isnan(a.lo) || std::isnan(a.hi) ? Interval::whole() : a;
+    }
+
+    // Interval products treat an infinite bound as "unbounded", so zero times it is zero
+    inline double product(double a, double b)
+    {
+        return a == 0. || b == 0. ? 0. : a * b;
+    }
+
+    inline Interval clamp(const Interval &a, double lo, double hi)
+    {
+        return {std::max(a.lo, lo), std::min(a.hi, hi)};
+    }
+
+    // Whether a may contain offset + k * period for an integer k. Near misses
+    // count as hits, that only widens the result.
+    bool containsPeriodic(const Interval &a, double offset, double period)
+    {
+        auto k = std::floor((a.hi - offset) / period + 1e-9);
+        auto point = offset + k * period;
+        return point >= a.lo - 1e-9 * (1. + std::fabs(a.lo));
+    }
+
+    // Monotone pieces between the extrema of sin shifted by offset
+    Interval periodic(const Interval &a, double (*function)(double), double maximum, double minimum)
+    {
+        if (!std::isfinite(a.lo) || !std::isfinite(a.hi) || a.width() >= 2. * pi)
+        {
+            return {-1., 1.};
+        }
+
+        auto lo = function(a.lo);
+        auto hi = function(a.hi);
+        auto result = widen(std::min(lo, hi), std::max(lo, hi));
+        if (containsPeriodic(a, maximum, 2. * pi))
+        {
+            result.hi = 1.;
+        }
+        if (containsPeriodic(a, minimum, 2. * pi))
+        {
+            result.lo = -1.;
+        }
+        return clamp(result, -1., 1.);
+    }
+
+    template <typename Function>
+    Interval increasing(const Interval &a, Function function)
+    {
+        return checked(widen(function(a.lo), function(a.hi)));
+    }
+}
+
+Interval Interval::whole() noexcept
+{
+    return {-infinity, infinity};
+}
+
+Interval hull(const Interval &a, const Interval &b)
+{
+    return {std::min(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+Interval intersect(const Interval &a, const Interval &b)
+{
+    return {std::max(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+Interval operator+(const Interval &a, const Interval &b)
+{
+    return checked({down(a.lo + b.lo), up(a.hi + b.hi)});
+}
+
+Interval operator-(const Interval &a, const Interval &b)
+{
+    return checked({down(a.lo - b.hi), up(a.hi - b.lo)});
+}
+
+Interval operator*(const Interval &a, const Interval &b)
+{
+    double products[] = {product(a.lo, b.lo), product(a.lo, b.hi), product(a.hi, b.lo), product(a.hi, b.hi)};
+    auto bounds = std::minmax_element(std::begin(products), std::end(products));
+    return checked({down(*bounds.first), up(*bounds.second)});
+}
+
+Interval operator/(const Interval &a, const Interval &b)
+{
+    if (b.contains(0.))
+    {
+        return Interval::whole();
+    }
+
+    double quotients[] = {a.lo / b.lo, a.lo / b.hi, a.hi / b.lo, a.hi / b.hi};
+    auto bounds = std::minmax_element(std::begin(quotients), std::end(quotients));
+    return checked({down(*bounds.first), up(*bounds.second)});
+}
+
+Interval operator-(const Interval &a)
+{
+    return {-a.hi, -a.lo};
+}
+
+Interval sqr(const Interval &a)
+{
+    auto magnitude = abs(a);
+    return checked({down(magnitude.lo * magnitude.lo), up(magnitude.hi * magnitude.hi)});
+}
+
+Interval pow(const Interval &a, const Interval &b)
+{
+    if (b.isPoint() && std::nearbyint(b.lo) == b.lo && std::fabs(b.lo) < 1e9)
+    {
+        auto n = b.lo;
+        if (n == 0.)
+        {
+            return {1., 1.};
+        }
+        if (n < 0.)
+        {
+            return Interval{1., 1.} / pow(a, {-n, -n});
+        }
+
+        // Odd powers are increasing, even ones are increasing in |a|
+        bool odd = std::fmod(n, 2.) != 0.;
+        auto base = odd ? a : abs(a);
+        auto result = widen(std::pow(base.lo, n), std::pow(base.hi, n));
+        return checked(odd ? result : clamp(result, 0., infinity));
+    }
+
+    if (a.lo < 0.)
+    {
+        return Interval::whole();
+    }
+    return clamp(exp(b * log(a)), 0., infinity);
+}
+
+Interval min(const Interval &a, const Interval &b)
+{
+    return {std::min(a.lo, b.lo), std::min(a.hi, b.hi)};
+}
+
+Interval max(const Interval &a, const Interval &b)
+{
+    return {std::max(a.lo, b.lo), std::max(a.hi, b.hi)};
+}
+
+Interval abs(const Interval &a)
+{
+    if (a.lo >= 0.)
+    {
+        return a;
+    }
+    if (a.hi <= 0.)
+    {
+        return -a;
+    }
+    return {0., std::max(-a.lo, a.hi)};
+}
+
+Interval sqrt(const Interval &a)
+{
+    if (a.lo < 0.)
+    {
+        return Interval::whole();
+    }
+    return clamp(widen(std::sqrt(a.lo), std::sqrt(a.hi)), 0., infinity);
+}
+
+Interval exp(const Interval &a)
+{
+    return clamp(increasing(a, [] (double x) { return std::exp(x); }), 0., infinity);
+}
+
+Interval log(const Interval &a)
+{
+    if (a.lo < 0.)
+    {
+        return Interval::whole();
+    }
+    return increasing(a, [] (double x) { return std::log(x); });
+}
+
+Interval sin(const Interval &a)
+{
+    return periodic(a, [] (double x) { return std::sin(x); }, 0.5 * pi, -0.5 * pi);
+}
+
+Interval cos(const Interval &a)
+{
+    return periodic(a, [] (double x) { return std::cos(x); }, 0., pi);
+}
+
+Interval tan(const Interval &a)
+{
+    if (!std::isfinite(a.lo) || !std::isfinite(a.hi) || a.width() >= pi ||
+        containsPeriodic(a, 0.5 * pi, pi))
+    {
+        return Interval::whole();
+    }
+    return increasing(a, [] (double x) { return std::tan(x); });
+}
+
+Interval asin(const Interval &a)
+{
+    if (a.lo < -1. || a.hi > 1.)
+    {
+        return Interval::whole();
+    }
+    return clamp(increasing(a, [] (double x) { return std::asin(x); }), -0.5 * up(pi), 0.5 * up(pi));
+}
+
+Interval acos(const Interval &a)
+{
+    if (a.lo < -1. || a.hi > 1.)
+    {
+        return Interval::whole();
+    }
+    // Decreasing, the bounds swap
+    return clamp(checked(widen(std::acos(a.hi), std::acos(a.lo))), 0., up(pi));
+}
+
+Interval atan(const Interval &a)
+{
+    return clamp(increasing(a, [] (double x) { return std::atan(x); }), -0.5 * up(pi), 0.5 * up(pi));
+}
+
+Interval sinh(const Interval &a)
+{
+    return increasing(a, [] (double x) { return std::sinh(x); });
+}
+
+Interval cosh(const Interval &a)
+{
+    auto magnitude = abs(a);
+    return clamp(increasing(magnitude, [] (double x) { return std::cosh(x); }), 1., infinity);
+}
+
+Interval tanh(const Interval &a)
+{
+    return clamp(increasing(a, [] (double x) { return std::tanh(x); }), -1., 1.);
+}
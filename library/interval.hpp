@@ -0,0 +1,79 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+
+// Closed interval [lo, hi] of reals. Every operation rounds outward, so the
+// result contains all values of the operation over its arguments; outside
+// the domain of a function the result is the whole real line.
+struct Interval
+{
+    double lo;
+    double hi;
+
+    [[nodiscard]] static Interval whole() noexcept;
+
+    [[nodiscard]] double width() const noexcept { return hi - lo; }
+
+    [[nodiscard]] double mid() const noexcept { return 0.5 * lo + 0.5 * hi; }
+
+    [[nodiscard]] bool contains(double x) const noexcept { return lo <= x && x <= hi; }
+
+    [[nodiscard]] bool isPoint() const noexcept { return lo == hi; }
+};
+
+enum class IntervalForm
+{
+    // Operations applied to the argument interval directly
+    Natural,
+    // F(c) + F'(X)(X - c) around the midpoint, intersected with the natural form;
+    // overestimation shrinks quadratically with the width
+    Centered
+};
+
+[[nodiscard]] Interval hull(const Interval &a, const Interval &b);
+
+// Both arguments must contain a common value
+[[nodiscard]] Interval intersect(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval operator+(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval operator-(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval operator*(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval operator/(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval operator-(const Interval &a);
+
+[[nodiscard]] Interval sqr(const Interval &a);
+
+[[nodiscard]] Interval pow(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval min(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval max(const Interval &a, const Interval &b);
+
+[[nodiscard]] Interval abs(const Interval &a);
+
+[[nodiscard]] Interval sqrt(const Interval &a);
+
+[[nodiscard]] Interval exp(const Interval &a);
+
+[[nodiscard]] Interval log(const Interval &a);
+
+[[nodiscard]] Interval sin(const Interval &a);
+
+[[nodiscard]] Interval cos(const Interval &a);
+
+[[nodiscard]] Interval tan(const Interval &a);
+
+[[nodiscard]] Interval asin(const Interval &a);
+
+[[nodiscard]] Interval acos(const Interval &a);
+
+[[nodiscard]] Interval atan(const Interval &a);
+
+[[nodiscard]] Interval sinh(const Interval &a);
+
+[[nodiscard]] Interval cosh(const Interval &a);
+
+[[nodiscard]] Interval tanh(const Interval &a);
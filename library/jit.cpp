@@ -0,0 +1,296 @@
+// Copyright Lebedev Alexander 2020
+#include "jit.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define SPPR_JIT 1
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    using Opcode = Expression::Opcode;
+
+    double callPow(double a, double b) { return std::pow(a, b); }
+    double callExp(double a) { return std::exp(a); }
+    double callLog(double a) { return std::log(a); }
+    double callSin(double a) { return std::sin(a); }
+    double callCos(double a) { return std::cos(a); }
+    double callTan(double a) { return std::tan(a); }
+    double callAsin(double a) { return std::asin(a); }
+    double callAcos(double a) { return std::acos(a); }
+    double callAtan(double a) { return std::atan(a); }
+    double callSinh(double a) { return std::sinh(a); }
+    double callCosh(double a) { return std::cosh(a); }
+    double callTanh(double a) { return std::tanh(a); }
+
+    void callSinCos(double a, double *s, double *c)
+    {
+        *s = std::sin(a);
+        *c = std::cos(a);
+    }
+
+    // Emits SysV x86-64 code. The register file lives in memory addressed
+    // through rbx, xmm0 and xmm1 are the only vector registers used.
+    class Assembler
+    {
+    public:
+        void bytes(std::initializer_list<uint8_t> values)
+        {
+            m_code.insert(m_code.end(), values.begin(), values.end());
+        }
+
+        void immediate64(uint64_t value)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                m_code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        // prefix 0F opcode with a ModRM for [rbx + disp32]
+        void memory(uint8_t prefix, uint8_t opcode, int xmm, uint32_t slot)
+        {
+            bytes({prefix, 0x0F, opcode, static_cast<uint8_t>(0x80 | (xmm << 3) | 3)});
+            displacement(slot);
+        }
+
+        void displacement(uint32_t slot)
+        {
+            auto offset = slot * static_cast<uint32_t>(sizeof(double));
+            for (int i = 0; i < 4; i++)
+            {
+                m_code.push_back(static_cast<uint8_t>(offset >> (8 * i)));
+            }
+        }
+
+        // lea of [rbx + disp32] into rdi (7) or rsi (6)
+        void address(int reg, uint32_t slot)
+        {
+            bytes({0x48, 0x8D, static_cast<uint8_t>(0x80 | (reg << 3) | 3)});
+            displacement(slot);
+        }
+
+        void load(int xmm, uint32_t slot)
+        {
+            memory(0xF2, 0x10, xmm, slot);
+        }
+
+        void store(uint32_t slot, int xmm)
+        {
+            memory(0xF2, 0x11, xmm, slot);
+        }
+
+        void scalar(uint8_t opcode, uint32_t slot)
+        {
+            memory(0xF2, opcode, 0, slot);
+        }
+
+        // xmm0 = bits op xmm1, used for sign manipulation
+        void mask(uint8_t opcode, uint64_t bits)
+        {
+            bytes({0x48, 0xB8});
+            immediate64(bits);
+            bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0});
+            bytes({0x66, 0x0F, opcode, 0xC1});
+        }
+
+        void call(const void *function)
+        {
+            bytes({0x48, 0xB8});
+            immediate64(reinterpret_cast<uint64_t>(function));
+            bytes({0xFF, 0xD0});
+        }
+
+        [[nodiscard]] const std::vector<uint8_t> &code() const noexcept
+        {
+            return m_code;
+        }
+
+    private:
+        std::vector<uint8_t> m_code;
+    };
+
+    const void *unaryFunction(Opcode op)
+    {
+        using Unary = double (*)(double);
+        Unary function = nullptr;
+        switch (op)
+        {
+        case Opcode::Exp:  function = callExp; break;
+        case Opcode::Log:  function = callLog; break;
+        case Opcode::Sin:  function = callSin; break;
+        case Opcode::Cos:  function = callCos; break;
+        case Opcode::Tan:  function = callTan; break;
+        case Opcode::Asin: function = callAsin; break;
+        case Opcode::Acos: function = callAcos; break;
+        case Opcode::Atan: function = callAtan; break;
+        case Opcode::Sinh: function = callSinh; break;
+        case Opcode::Cosh: function = callCosh; break;
+        case Opcode::Tanh: function = callTanh; break;
+        default: break;
+        }
+        return reinterpret_cast<const void *>(function);
+    }
+}
+
+JitExpression::JitExpression(const Expression &expression)
+        : m_expression(expression),
+          m_constants(expression.getConstants()),
+          m_registers(expression.getRegisterCount()),
+          m_memory(nullptr),
+          m_size(0),
+          m_entry(nullptr)
+{
+    if (m_expression.isValid())
+    {
+        compile();
+    }
+}
+
+JitExpression::~JitExpression()
+{
+#ifdef SPPR_JIT
+    if (m_memory)
+    {
+        munmap(m_memory, m_size);
+    }
+#endif
+}
+
+bool JitExpression::isCompiled() const noexcept
+{
+    return m_entry != nullptr;
+}
+
+void JitExpression::compile()
+{
+#ifdef SPPR_JIT
+    Assembler assembler;
+
+    // push rbx keeps the stack 16-byte aligned for the libm calls
+    assembler.bytes({0x53});
+    assembler.bytes({0x48, 0x89, 0xFB});
+    assembler.store(m_expression.getVariableRegister(), 0);
+
+    for (const auto &instruction : m_expression.getCode())
+    {
+        switch (instruction.op)
+        {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Div:
+        {
+            uint8_t opcode = instruction.op == Opcode::Add ? 0x58
+                           : instruction.op == Opcode::Sub ? 0x5C
+                           : instruction.op == Opcode::Mul ? 0x59
+                           : 0x5E;
+            assembler.load(0, instruction.lhs);
+            assembler.scalar(opcode, instruction.rhs);
+            break;
+        }
+        case Opcode::Min:
+        case Opcode::Max:
+            // minsd/maxsd return the second operand on ties and NaN, loading
+            // b first gives exactly std::min(a, b) and std::max(a, b)
+            assembler.load(0, instruction.rhs);
+            assembler.scalar(instruction.op == Opcode::Min ? 0x5D : 0x5F, instruction.lhs);
+            break;
+        case Opcode::Sqrt:
+            assembler.scalar(0x51, instruction.lhs);
+            break;
+        case Opcode::Neg:
+            assembler.load(1, instruction.lhs);
+            assembler.mask(0x57, 0x8000000000000000ull);
+            break;
+        case Opcode::Abs:
+            assembler.load(1, instruction.lhs);
+            assembler.mask(0x54, 0x7FFFFFFFFFFFFFFFull);
+            break;
+        case Opcode::Pow:
+            assembler.load(0, instruction.lhs);
+            assembler.load(1, instruction.rhs);
+            assembler.call(reinterpret_cast<const void *>(&callPow));
+            break;
+        case Opcode::SinCos:
+            // Both results are written through pointers into the register file
+            assembler.address(7, instruction.dst);
+            assembler.address(6, instruction.rhs);
+            assembler.load(0, instruction.lhs);
+            assembler.call(reinterpret_cast<const void *>(&callSinCos));
+            continue;
+        case Opcode::Const:
+        case Opcode::Var:
+            continue;
+        default:
+            assembler.load(0, instruction.lhs);
+            assembler.call(unaryFunction(instruction.op));
+            break;
+        }
+        assembler.store(instruction.dst, 0);
+    }
+
+    assembler.load(0, m_expression.getResultRegister());
+    assembler.bytes({0x5B, 0xC3});
+
+    const auto &code = assembler.code();
+    m_size = code.size();
+    void *memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        return;
+    }
+
+    std::memcpy(memory, code.data(), m_size);
+    if (mprotect(memory, m_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(memory, m_size);
+        return;
+    }
+
+    m_memory = memory;
+    m_entry = reinterpret_cast<Entry>(memory);
+#endif
+}
+
+double JitExpression::evaluate(double x) const
+{
+    if (!m_entry)
+    {
+        return m_expression.evaluate(x);
+    }
+
+    constexpr uint32_t stackRegisters = 64;
+    double stack[stackRegisters];
+    std::vector<double> heap;
+    double *r = stack;
+    if (m_registers > stackRegisters)
+    {
+        heap.resize(m_registers);
+        r = heap.data();
+    }
+
+    std::copy(m_constants.begin(), m_constants.end(), r);
+    return m_entry(x, r);
+}
+
+void JitExpression::evaluate(const double *x, double *z, size_t count) const
+{
+    if (!m_entry)
+    {
+        m_expression.evaluate(x, z, count);
+        return;
+    }
+
+    // Constants are never overwritten, so one register file serves all points
+    std::vector<double> r(std::max<uint32_t>(m_registers, 1));
+    std::copy(m_constants.begin(), m_constants.end(), r.begin());
+    for (size_t i = 0; i < count; i++)
+    {
+        z[i] = m_entry(x[i], r.data());
+    }
+}
@@ -0,0 +1,43 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "expression.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compiles the bytecode of an expression to x86-64 machine code with SSE2
+// scalar instructions, transcendental functions are called from libm.
+// On other hosts, or when executable memory is unavailable, evaluation
+// falls back to the bytecode interpreter.
+class JitExpression
+{
+public:
+    explicit JitExpression(const Expression &expression);
+
+    ~JitExpression();
+
+    JitExpression(const JitExpression &) = delete;
+
+    JitExpression &operator=(const JitExpression &) = delete;
+
+    [[nodiscard]] bool isCompiled() const noexcept;
+
+    [[nodiscard]] double evaluate(double x) const;
+
+    void evaluate(const double *x, double *z, size_t count) const;
+
+    double operator()(double x) const { return evaluate(x); }
+
+private:
+    using Entry = double (*)(double x, double *registers);
+
+    void compile();
+
+    Expression          m_expression;
+    std::vector<double> m_constants;
+    uint32_t            m_registers;
+    void               *m_memory;
+    size_t              m_size;
+    Entry               m_entry;
+};
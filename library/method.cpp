@@ -10,24 +10,57 @@ IMethod::IMethod(uint32_t count,
                  std::function<double(double)> function)
         : m_maxCount(count),
           m_eps(eps),
-          m_function(function)
+          m_function(function),
+          m_pruning(false),
+          m_tolerance(0.),
+          m_observer(nullptr),
+          m_reportIterations(0),
+          m_reportInterval(0),
+          m_token(nullptr),
+          m_batchSize(1),
+          m_lipschitzMode(LipschitzMode::Estimate),
+          m_lipschitzBound(std::numeric_limits<double>::infinity()),
+          m_confirmTolerance(0.),
+          m_fineCount(0),
+          m_boundedCount(0)
 {
     
 }
 
 double inline IMethod::f(double x) const
 {
+    if (m_cache)
+    {
+        return m_cache->evaluate(x, m_function);
+    }
     return m_function(x);
 }
 
-double inline IMethod::getOptimalInex()
+double inline IMethod::getOptimalInex(double globalMin)
 {
-    double maxValue = std::numeric_limits<double>::min();
-    int index = 1;
+    double maxValue = std::numeric_limits<double>::lowest();
+    int index = 0;
+    m_characteristics.clear();
 
     for (int i = 1; i < m_x.size(); i++)
     {
-        auto value = getValue(m_x[i - 1], m_x[i]);
+        if (m_retired[i])
+        {
+            continue;
+        }
+
+        if (m_pruning && getLowerBound(i) > globalMin - m_tolerance)
+        {
+            m_retired[i] = 1;
+            continue;
+        }
+
+        auto value = getValue(m_x[i - 1], m_z[i - 1], m_x[i], m_z[i]);
+        if (m_batchSize > 1)
+        {
+            m_characteristics.emplace_back(value, i);
+        }
+
         if (value > maxValue)
         {
             maxValue = value;
@@ -38,53 +71,521 @@ double inline IMethod::getOptimalInex()
     return index;
 }
 
+double IMethod::getLowerBound(size_t index)
+{
+    if (!m_enclosure)
+    {
+        return getBound(m_x[index - 1], m_z[index - 1], m_x[index], m_z[index]);
+    }
+
+    // Intervals only change when split, so each enclosure is computed once
+    if (std::isnan(m_bounds[index]))
+    {
+        m_bounds[index] = m_enclosure({m_x[index - 1], m_x[index]}).lo;
+    }
+    return m_bounds[index];
+}
+
+void IMethod::prune()
+{
+    // A trial is kept while at least one of its neighbouring intervals is live,
+    // adjacent retired intervals collapse into one.
+    size_t last = 0;
+    for (size_t i = 1; i < m_x.size(); i++)
+    {
+        bool inner = i + 1 < m_x.size();
+        if (inner && m_retired[i] && m_retired[i + 1])
+        {
+            continue;
+        }
+
+        last++;
+        m_x[last] = m_x[i];
+        m_z[last] = m_z[i];
+        m_retired[last] = m_retired[i];
+        m_bounds[last] = m_bounds[i];
+        m_coarseZ[last] = m_coarseZ[i];
+        m_bounded[last] = m_bounded[i];
+    }
+
+    m_x.resize(last + 1);
+    m_z.resize(last + 1);
+    m_retired.resize(last + 1);
+    m_bounds.resize(last + 1);
+    m_coarseZ.resize(last + 1);
+    m_bounded.resize(last + 1);
+}
+
+void IMethod::setPruning(double tolerance)
+{
+    m_pruning = true;
+    m_tolerance = tolerance;
+}
+
+double IMethod::getBound(double x1, double z1, double x2, double z2)
+{
+    return std::numeric_limits<double>::lowest();
+}
+
+void IMethod::setBatch(uint32_t size, BatchFunction function)
+{
+    m_batchSize = std::max(1u, size);
+    m_batchFunction = function;
+}
+
+void IMethod::setEnclosure(EnclosureFunction enclosure)
+{
+    m_enclosure = enclosure;
+}
+
+void IMethod::setLipschitz(LipschitzMode mode, EnclosureFunction derivative)
+{
+    m_lipschitzMode = mode;
+    m_derivative = derivative;
+}
+
+void IMethod::setCache(std::shared_ptr<EvaluationCache> cache)
+{
+    m_cache = std::move(cache);
+}
+
+void IMethod::setCoarse(std::function<double(double)> coarse, double tolerance)
+{
+    m_coarse = std::move(coarse);
+    m_confirmTolerance = std::max(0., tolerance);
+}
+
+uint32_t IMethod::getFineCount() const noexcept
+{
+    return m_fineCount;
+}
+
+void IMethod::setBounded(BoundedFunction function)
+{
+    m_boundedFunction = std::move(function);
+}
+
+uint32_t IMethod::getBoundedCount() const noexcept
+{
+    return m_boundedCount;
+}
+
+double IMethod::getCutoff(double globalMin, size_t index)
+{
+    if (!m_boundedFunction)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    // As far above the best value as the interval's bound lies below it: such a trial is
+    // no new minimum, and its lower bound serves the model nearly as well as the value
+    double lower = getLowerBound(index);
+    if (!std::isfinite(lower))
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+    return globalMin + std::max(0., globalMin - lower);
+}
+
+bool IMethod::resolve(size_t index, double *globalMin, double *point)
+{
+    bool resolved = false;
+    for (auto i : {index - 1, index})
+    {
+        if (!m_bounded[i])
+        {
+            continue;
+        }
+
+        m_z[i] = f(m_x[i]);
+        m_bounded[i] = 0;
+        m_boundedCount--;
+        m_fineCount++;
+        resolved = true;
+
+        // Only if the objective broke its contract and stopped below the cutoff
+        if (m_z[i] < *globalMin)
+        {
+            *globalMin = m_z[i];
+            *point = m_x[i];
+        }
+    }
+    return resolved;
+}
+
+double IMethod::getNextPoint(size_t index)
+{
+    double x1 = m_x[index - 1];
+    double x2 = m_x[index];
+    double x = getPoint(x1, m_z[index - 1], x2, m_z[index]);
+
+    // An m below the slope of the interval would place the point outside of it
+    if (!(x > x1 && x < x2))
+    {
+        x = 0.5 * (x1 + x2);
+    }
+    return x;
+}
+
+double IMethod::getSlope(size_t index) const
+{
+    double dx = m_x[index] - m_x[index - 1];
+    double dz = m_z[index] - m_z[index - 1];
+
+    // A bounded end can only be higher than its bound
+    if (m_bounded[index - 1] && m_bounded[index])
+    {
+        return 0.;
+    }
+    if (m_bounded[index])
+    {
+        return std::max(0., dz) / dx;
+    }
+    if (m_bounded[index - 1])
+    {
+        return std::max(0., -dz) / dx;
+    }
+    return std::fabs(dz) / dx;
+}
+
+double IMethod::getBias(double x) const
+{
+    if (m_bias.empty())
+    {
+        return 0.;
+    }
+
+    auto right = std::lower_bound(m_bias.begin(), m_bias.end(), std::make_pair(x, std::numeric_limits<double>::lowest()));
+    if (right == m_bias.begin())
+    {
+        return right->second;
+    }
+    if (right == m_bias.end())
+    {
+        return m_bias.back().second;
+    }
+
+    auto left = right - 1;
+    double t = (x - left->first) / (right->first - left->first);
+    return left->second + t * (right->second - left->second);
+}
+
+double IMethod::confirm(size_t position)
+{
+    double x = m_x[position];
+    double z = f(x);
+    m_fineCount++;
+
+    if (std::isfinite(z) && std::isfinite(m_coarseZ[position]))
+    {
+        auto bias = std::make_pair(x, z - m_coarseZ[position]);
+        m_bias.insert(std::upper_bound(m_bias.begin(), m_bias.end(), bias), bias);
+
+        for (size_t i = 0; i < m_x.size(); i++)
+        {
+            if (i != position && !std::isnan(m_coarseZ[i]))
+            {
+                m_z[i] = m_coarseZ[i] + getBias(m_x[i]);
+            }
+        }
+    }
+
+    m_z[position] = z;
+    m_coarseZ[position] = std::numeric_limits<double>::quiet_NaN();
+    return z;
+}
+
+double IMethod::getModelConstant(double estimate, double parameter, double sufficient) const
+{
+    double scaled = estimate <= 0. ? 1. : parameter * estimate;
+    if (!std::isfinite(m_lipschitzBound) || m_lipschitzBound <= 0.)
+    {
+        return scaled;
+    }
+
+    switch (m_lipschitzMode)
+    {
+    case LipschitzMode::Bound:
+        return parameter * m_lipschitzBound;
+    case LipschitzMode::Tighter:
+        return estimate <= 0. ? sufficient * m_lipschitzBound : std::min(scaled, sufficient * m_lipschitzBound);
+    case LipschitzMode::Estimate:
+        break;
+    }
+    return scaled;
+}
+
+void IMethod::evaluateBatch()
+{
+    m_batchZ.resize(m_batchX.size());
+    m_batchBounded.assign(m_batchX.size(), 0);
+
+    if (m_coarse)
+    {
+        // Predictions only, candidates are confirmed when inserted
+        m_batchCoarse.resize(m_batchX.size());
+        for (size_t i = 0; i < m_batchX.size(); i++)
+        {
+            m_batchCoarse[i] = m_coarse(m_batchX[i]);
+            m_batchZ[i] = m_batchCoarse[i] + getBias(m_batchX[i]);
+        }
+        return;
+    }
+
+    if (m_boundedFunction)
+    {
+        for (size_t i = 0; i < m_batchX.size(); i++)
+        {
+            bool exact = true;
+            m_batchZ[i] = m_cache ? m_cache->evaluate(m_batchX[i], m_batchCutoff[i], &exact, m_boundedFunction)
+                                  : m_boundedFunction(m_batchX[i], m_batchCutoff[i], &exact);
+            m_batchBounded[i] = !exact;
+        }
+        return;
+    }
+
+    if (m_cache)
+    {
+        m_cache->evaluate(m_batchX.data(), m_batchZ.data(), m_batchX.size(),
+                          m_batchFunction ? m_batchFunction : makeBatchFunction(m_function));
+        return;
+    }
+
+    if (m_batchFunction)
+    {
+        m_batchFunction(m_batchX.data(), m_batchZ.data(), m_batchX.size());
+        return;
+    }
+
+    for (size_t i = 0; i < m_batchX.size(); i++)
+    {
+        m_batchZ[i] = f(m_batchX[i]);
+    }
+}
+
+void IMethod::setObserver(IObserver *observer,
+                          uint32_t iterations,
+                          std::chrono::milliseconds interval)
+{
+    m_observer = observer;
+    m_reportIterations = iterations;
+    m_reportInterval = interval;
+}
+
+void IMethod::setCancellationToken(const CancellationToken *token)
+{
+    m_token = token;
+}
+
+SearchState IMethod::getState() const
+{
+    return m_state.load();
+}
+
+Trial IMethod::getModelMinimum(const Trial &left, const Trial &right, double m) const
+{
+    return {std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN()};
+}
+
+double IMethod::getLipschitz() const
+{
+    return 0.;
+}
+
+void IMethod::report(uint32_t iteration, double min, double point)
+{
+    size_t intervals = 0;
+    for (size_t i = 1; i < m_x.size(); i++)
+    {
+        intervals += m_retired[i] ? 0 : 1;
+    }
+
+    m_observer->onProgress({iteration, min, point, getLipschitz(), intervals});
+    m_lastReport = std::chrono::steady_clock::now();
+}
+
 void IMethod::execute(uint32_t *count, double *min, double *point, double x1, double x2)
 {
     double   currEps = std::numeric_limits<double>::max();
     double   currPoint;
     double   globalMin;
 
-    if(f(x1) > f(x2))
+    // Every run starts from the two ends, estimates of a previous run do not carry over
+    m_x.clear();
+    m_z.clear();
+    reset();
+
+    double z1 = f(x1);
+    double z2 = f(x2);
+    m_fineCount = 2;
+
+    m_bias.clear();
+    if (m_coarse)
+    {
+        m_bias.emplace_back(x1, z1 - m_coarse(x1));
+        m_bias.emplace_back(x2, z2 - m_coarse(x2));
+        std::sort(m_bias.begin(), m_bias.end());
+        m_bias.erase(std::remove_if(m_bias.begin(), m_bias.end(), [] (const std::pair<double, double> &point) {
+            return !std::isfinite(point.second);
+        }), m_bias.end());
+    }
+
+    m_lipschitzBound = std::numeric_limits<double>::infinity();
+    if (m_derivative && m_lipschitzMode != LipschitzMode::Estimate)
+    {
+        auto slope = m_derivative({x1, x2});
+        m_lipschitzBound = std::max(std::fabs(slope.lo), std::fabs(slope.hi));
+    }
+
+    if(z1 > z2)
     {
-        globalMin = f(x2);
+        globalMin = z2;
         currPoint = x2;
     } else
     {
-        globalMin = f(x1);
+        globalMin = z1;
         currPoint = x1;
     }
     
     uint32_t currCount = 0;
+    uint32_t reported  = 0;
 
     m_x.push_back(x1);
     m_x.push_back(x2);
+    m_z.push_back(z1);
+    m_z.push_back(z2);
+    m_retired.assign(m_x.size(), 0);
+    m_bounds.assign(m_x.size(), std::numeric_limits<double>::quiet_NaN());
+    m_coarseZ.assign(m_x.size(), std::numeric_limits<double>::quiet_NaN());
+    m_bounded.assign(m_x.size(), 0);
+    m_boundedCount = 0;
+
+    if (m_observer)
+    {
+        m_observer->onTrial({x1, z1});
+        m_observer->onTrial({x2, z2});
+    }
+
+    m_lastReport = std::chrono::steady_clock::now();
+    m_state.publish({0, globalMin, currPoint, 0.});
 
     do
     {
+        if (m_token && m_token->isCancelled())
+        {
+            break;
+        }
+
         preprocess();
 
-        auto index = getOptimalInex();
+        auto index = getOptimalInex(globalMin);
 
-        auto left = m_x[index - 1];
-        auto right = m_x[index];
-        auto middle = getPoint(left, right);
+        if (index == 0)
+        {
+            break;
+        }
 
-        currEps = std::fabs(right - left);
+        // A lower bound is no value: intervals are only split with exact ends,
+        // the model is rebuilt after a bounded end is evaluated exactly
+        size_t size = 1;
+        if (m_batchSize > 1)
+        {
+            size = m_maxCount > currCount ? std::min(m_batchSize, m_maxCount - currCount) : 1;
+            size = std::min(size, m_characteristics.size());
+            std::nth_element(m_characteristics.begin(),
+                             m_characteristics.begin() + (size - 1),
+                             m_characteristics.end(),
+                             std::greater<std::pair<double, size_t>>());
+
+            bool resolved = false;
+            for (size_t i = 0; i < size; i++)
+            {
+                resolved = resolve(m_characteristics[i].second, &globalMin, &currPoint) || resolved;
+            }
+            if (resolved)
+            {
+                continue;
+            }
+        } else if (resolve(index, &globalMin, &currPoint))
+        {
+            continue;
+        }
 
-        m_x.push_back(middle);
+        currEps = std::fabs(m_x[index] - m_x[index - 1]);
 
-        std::sort(m_x.begin(), m_x.end());
+        m_batchX.clear();
+        m_batchCutoff.clear();
+        for (size_t i = 0; i < size; i++)
+        {
+            auto selected = m_batchSize > 1 ? m_characteristics[i].second : static_cast<size_t>(index);
+            m_batchX.push_back(getNextPoint(selected));
+            m_batchCutoff.push_back(getCutoff(globalMin, selected));
+        }
 
-        auto currMin = m_function(middle);
+        if (m_pruning)
+        {
+            prune();
+        }
 
-        if (currMin < globalMin)
+        evaluateBatch();
+        if (!m_coarse)
         {
-            globalMin = currMin;
-            currPoint = middle;
+            m_fineCount += static_cast<uint32_t>(m_batchX.size());
         }
 
-        currCount++;
+        for (size_t i = 0; i < m_batchX.size(); i++)
+        {
+            auto middle = m_batchX[i];
+            auto currMin = m_batchZ[i];
+            bool bounded = m_batchBounded[i] != 0;
+
+            auto position = std::upper_bound(m_x.begin(), m_x.end(), middle) - m_x.begin();
+            m_x.insert(m_x.begin() + position, middle);
+            m_z.insert(m_z.begin() + position, currMin);
+            m_retired.insert(m_retired.begin() + position, 0);
+            m_bounds.insert(m_bounds.begin() + position, std::numeric_limits<double>::quiet_NaN());
+            m_bounds[position + 1] = std::numeric_limits<double>::quiet_NaN();
+            m_bounded.insert(m_bounded.begin() + position, bounded);
+            m_boundedCount += bounded ? 1 : 0;
+            m_coarseZ.insert(m_coarseZ.begin() + position,
+                             m_coarse ? m_batchCoarse[i] : std::numeric_limits<double>::quiet_NaN());
+
+            // Only a confirmed value can become the result
+            if (m_coarse && currMin < globalMin + m_confirmTolerance)
+            {
+                currMin = confirm(position);
+            }
+
+            if (currMin < globalMin && !bounded)
+            {
+                globalMin = currMin;
+                currPoint = middle;
+            }
+
+            currCount++;
+
+            m_state.publish({currCount, globalMin, currPoint, getLipschitz()});
+
+            if (m_observer)
+            {
+                m_observer->onTrial({middle, currMin});
+
+                bool byCount = m_reportIterations && currCount % m_reportIterations == 0;
+                bool byTime = m_reportInterval.count() &&
+                              std::chrono::steady_clock::now() - m_lastReport >= m_reportInterval;
+                if (byCount || byTime)
+                {
+                    report(currCount, globalMin, currPoint);
+                    reported = currCount;
+                }
+            }
+        }
     } while (currEps >= m_eps && currCount < m_maxCount);
+
+    if (m_observer && reported != currCount)
+    {
+        report(currCount, globalMin, currPoint);
+    }
     
     *count = currCount;
     *min = globalMin;
@@ -96,6 +597,11 @@ std::vector<double> IMethod::getXVector() const
     return m_x;
 }
 
+TrialView IMethod::getTrials() const noexcept
+{
+    return {m_x.data(), m_z.data(), m_x.size()};
+}
+
 SeqScanMethod::SeqScanMethod(uint32_t count,
                              double eps,
                              std::function<double(double)> function)
@@ -104,48 +610,82 @@ SeqScanMethod::SeqScanMethod(uint32_t count,
     // Empty constructor
 }                                    
 
-double SeqScanMethod::getValue(double x1, double x2)
+double SeqScanMethod::getValue(double x1, double z1, double x2, double z2)
 {
     return x2 - x1;
 }
 
-double SeqScanMethod::getPoint(double x1, double x2)
+double SeqScanMethod::getPoint(double x1, double z1, double x2, double z2)
 {
     return (x1 + x2) / 2;
 }
 
 void SeqScanMethod::preprocess() { }
 
+void SeqScanMethod::reset() { }
+
 PiyavskiyMethod::PiyavskiyMethod(uint32_t count,
                              double eps,
                              double parameter,
                              std::function<double(double)> function)
         : IMethod(count, eps, function),
-          m_parameter(parameter)
+          m_parameter(parameter),
+          m_lipschitz(0.),
+          m(0.)
 {
     // Empty constructor
 }                                    
 
-double PiyavskiyMethod::getValue(double x1, double x2)
+double PiyavskiyMethod::getValue(double x1, double z1, double x2, double z2)
 {
-    return 0.5 * m * (x2 - x1) - (f(x2) + f(x1)) / 2.;
+    return 0.5 * m * (x2 - x1) - (z2 + z1) / 2.;
 }
 
-double PiyavskiyMethod::getPoint(double x1, double x2)
+double PiyavskiyMethod::getPoint(double x1, double z1, double x2, double z2)
 {
-    return (0.5 * (x2 + x1)) - (f(x2) - f(x1)) / (2. * m);
+    return (0.5 * (x2 + x1)) - (z2 - z1) / (2. * m);
 }
 
 void PiyavskiyMethod::preprocess()
 {
-    double M = 0.;
+    // Slope estimates never decrease while trials are added, so the running
+    // maximum keeps the ones lost when retired intervals are dropped.
+    double M = m_lipschitz;
     for (int i = 1; i < m_x.size(); i++)
     {
-        double prevX = m_x[i - 1];
-        double currX = m_x[i];
-        M = std::max(M, std::fabs(f(currX) - f(prevX)) / (currX - prevX));
+        if (m_retired[i])
+        {
+            continue;
+        }
+
+        M = std::max(M, getSlope(i));
     }
-    m = (M <= 0. ? 1. : m_parameter * M);
+    m_lipschitz = M;
+    // The saw-tooth is a minorant for any m >= L
+    m = getModelConstant(M, m_parameter, 1.);
+}
+
+void PiyavskiyMethod::reset()
+{
+    m_lipschitz = 0.;
+    m = 0.;
+}
+
+double PiyavskiyMethod::getBound(double x1, double z1, double x2, double z2)
+{
+    return 0.5 * (z2 + z1) - 0.5 * m * (x2 - x1);
+}
+
+double PiyavskiyMethod::getLipschitz() const
+{
+    return m;
+}
+
+Trial PiyavskiyMethod::getModelMinimum(const Trial &left, const Trial &right, double m) const
+{
+    // Vertex of the saw-tooth minorant between two trials
+    return {0.5 * (right.x + left.x) - (right.z - left.z) / (2. * m),
+            0.5 * (right.z + left.z) - 0.5 * m * (right.x - left.x)};
 }
 
 StronginMethod::StronginMethod(uint32_t count,
@@ -153,32 +693,63 @@ StronginMethod::StronginMethod(uint32_t count,
                              double parameter,
                              std::function<double(double)> function)
         : IMethod(count, eps, function),
-          m_parameter(parameter)
+          m_parameter(parameter),
+          m_lipschitz(0.),
+          m(0.)
 {
     // Empty constructor
 }                                    
 
-double StronginMethod::getValue(double x1, double x2)
+double StronginMethod::getValue(double x1, double z1, double x2, double z2)
 {
-    double z1 = f(x1);
-    double z2 = f(x2);
-
     return m * (x2 - x1) + (z2 - z1) * (z2 - z1) / (m * (x2 - x1)) - 2 * (z1 + z2);
 }
 
-double StronginMethod::getPoint(double x1, double x2)
+double StronginMethod::getPoint(double x1, double z1, double x2, double z2)
 {
-    return 0.5 * (x2 + x1) - (f(x2) - f(x1)) / (2 * m);
+    return 0.5 * (x2 + x1) - (z2 - z1) / (2 * m);
 }
 
 void StronginMethod::preprocess()
 {
-    double M = 0.;
+    double M = m_lipschitz;
     for (int i = 1; i < m_x.size(); i++)
     {
-        double prevX = m_x[i - 1];
-        double currX = m_x[i];
-        M = std::max(M, std::fabs(f(currX) - f(prevX)) / (currX - prevX));
+        if (m_retired[i])
+        {
+            continue;
+        }
+
+        M = std::max(M, getSlope(i));
     }
-    m = (M <= 0. ? 1. : m_parameter * M);
+    m_lipschitz = M;
+    // Convergence to the global minimum needs m > 2L
+    m = getModelConstant(M, m_parameter, 2.);
+}
+
+void StronginMethod::reset()
+{
+    m_lipschitz = 0.;
+    m = 0.;
+}
+
+double StronginMethod::getBound(double x1, double z1, double x2, double z2)
+{
+    // Lipschitz cone bound with the estimated m, the characteristic itself is not a minorant
+    return 0.5 * (z2 + z1) - 0.5 * m * (x2 - x1);
+}
+
+double StronginMethod::getLipschitz() const
+{
+    return m;
+}
+
+Trial StronginMethod::getModelMinimum(const Trial &left, const Trial &right, double m) const
+{
+    // The characteristic R scaled to the units of f: -R / 4 is the
+    // estimate of the minimum over the interval
+    double dx = right.x - left.x;
+    double dz = right.z - left.z;
+    return {0.5 * (right.x + left.x) - dz / (2. * m),
+            0.5 * (right.z + left.z) - 0.25 * (m * dx + dz * dz / (m * dx))};
 }
@@ -1,11 +1,32 @@
 // Copyright Lebedev Alexander 2020
 #pragma once
+#include "cache.hpp"
+#include "objective.hpp"
+#include "progress.hpp"
+#include "snapshot.hpp"
+#include "trials.hpp"
+
+#include <chrono>
 #include <cstdint>
 #include <set>
 #include <utility>
 #include <functional>
+#include <memory>
 #include <vector>
 
+// Where the constant m of the Piyavskiy and Strongin models comes from
+enum class LipschitzMode
+{
+    // r times the largest slope between neighbouring trials
+    Estimate,
+    // r times max |F'| over [x1, x2] from the derivative enclosure, known
+    // before the first trial
+    Bound,
+    // The smaller of the scaled estimate and the smallest m the method is
+    // proven to converge with for that bound, so a large r costs no trials
+    Tighter
+};
+
 class IMethod
 {
 public:
@@ -19,23 +40,157 @@ public:
 
     void execute(uint32_t *count, double *min, double *point, double x1, double x2);
 
+    // Retire intervals whose lower bound exceeds the best value minus tolerance.
+    // Retired intervals are never selected again and their interior trials are dropped.
+    void setPruning(double tolerance);
+
+    // Observer is called every `iterations` trials or every `interval`, whichever
+    // comes first; zero disables the corresponding trigger.
+    void setObserver(IObserver *observer,
+                     uint32_t iterations,
+                     std::chrono::milliseconds interval = std::chrono::milliseconds(0));
+
+    void setCancellationToken(const CancellationToken *token);
+
+    // Every iteration splits the `size` best intervals and evaluates their
+    // points with one call; without a batch function f is called per point.
+    void setBatch(uint32_t size, BatchFunction function = nullptr);
+
+    // Pruning takes lower bounds from the enclosure instead of the method model,
+    // so no interval holding the global minimum is retired whatever M is.
+    void setEnclosure(EnclosureFunction enclosure);
+
+    // Without a derivative enclosure, or when it is unbounded, the estimate is used.
+    void setLipschitz(LipschitzMode mode, EnclosureFunction derivative);
+
+    // Trials and batches look their points up in the cache first and store what they evaluate.
+    void setCache(std::shared_ptr<EvaluationCache> cache);
+
+    // Multi-fidelity search: new points are evaluated with the coarse function plus
+    // a bias model, and only those predicted below the best value plus tolerance are
+    // confirmed with f. Every confirmation adds f - coarse at that point to the model,
+    // which interpolates it linearly, and corrects the predictions of the other trials.
+    // The result is always a confirmed value.
+    void setCoarse(std::function<double(double)> coarse, double tolerance = 0.);
+
+    // New trials are evaluated with a cutoff of the best value plus how far the lower
+    // bound of their interval lies below it. A trial stopped early keeps its lower bound:
+    // it never becomes the result and only enters the slope estimate where the bound
+    // proves the slope. Once an interval with such an end is selected, the end is
+    // evaluated exactly before the interval is split. The ends of the segment are exact.
+    void setBounded(BoundedFunction function);
+
+    // Trials of the last execute() left with a lower bound only
+    [[nodiscard]] uint32_t getBoundedCount() const noexcept;
+
+    // Evaluations of f in the last execute(), including the two ends
+    [[nodiscard]] uint32_t getFineCount() const noexcept;
+
+    // Consistent view of the running search, safe to call from any thread.
+    [[nodiscard]] SearchState getState() const;
+
     double inline f(double x) const;
 
     std::vector<double> getXVector() const;
 
+    [[nodiscard]] TrialView getTrials() const noexcept;
+
+    // Lowest point of the model the method builds over [left, right] for a given M,
+    // NaN when the method has no such model. Does not touch the method state.
+    [[nodiscard]] virtual Trial getModelMinimum(const Trial &left, const Trial &right, double m) const;
+
 protected:
-    [[nodiscard]] virtual double getValue(double x1, double x2) = 0;
+    [[nodiscard]] virtual double getValue(double x1, double z1, double x2, double z2) = 0;
 
-    [[nodiscard]] virtual double getPoint(double x1, double x2) = 0;
+    [[nodiscard]] virtual double getPoint(double x1, double z1, double x2, double z2) = 0;
 
     virtual void preprocess() = 0;
 
-    double inline getOptimalInex();
+    // Clears the model state of a previous execute()
+    virtual void reset() = 0;
+
+    [[nodiscard]] virtual double getBound(double x1, double z1, double x2, double z2);
+
+    double inline getOptimalInex(double globalMin);
+
+    [[nodiscard]] double getLowerBound(size_t index);
+
+    void prune();
+
+    void evaluateBatch();
+
+    [[nodiscard]] double getBias(double x) const;
+
+    // Evaluations of the interval's new point may stop once they reach this value
+    [[nodiscard]] double getCutoff(double globalMin, size_t index);
+
+    // Evaluates bounded ends of the interval exactly, true if there were any
+    bool resolve(size_t index, double *globalMin, double *point);
+
+    // Next trial in the interval, kept strictly inside it
+    [[nodiscard]] double getNextPoint(size_t index);
+
+    // |F'| estimate over an interval, a proven lower bound when an end is only bounded
+    [[nodiscard]] double getSlope(size_t index) const;
+
+    // Evaluates f at a predicted trial and corrects the other predictions
+    double confirm(size_t position);
+
+    [[nodiscard]] virtual double getLipschitz() const;
+
+    // m for the slope estimate and the reliability parameter according to the mode,
+    // `sufficient` times the Lipschitz constant is the least m that guarantees convergence
+    [[nodiscard]] double getModelConstant(double estimate, double parameter, double sufficient) const;
+
+    void report(uint32_t iteration, double min, double point);
 
     uint32_t                      m_maxCount;
     double                        m_eps;
     std::function<double(double)> m_function;
     std::vector<double>           m_x;
+    std::vector<double>           m_z;
+    std::vector<char>             m_retired;
+    bool                          m_pruning;
+    double                        m_tolerance;
+
+    IObserver                             *m_observer;
+    uint32_t                               m_reportIterations;
+    std::chrono::milliseconds              m_reportInterval;
+    std::chrono::steady_clock::time_point  m_lastReport;
+    const CancellationToken               *m_token;
+    StatePublisher                         m_state;
+
+    uint32_t                               m_batchSize;
+    BatchFunction                          m_batchFunction;
+    std::vector<std::pair<double, size_t>> m_characteristics;
+    std::vector<double>                    m_batchX;
+    std::vector<double>                    m_batchZ;
+
+    EnclosureFunction                      m_enclosure;
+    // Lower bound of the enclosure per interval, NaN until requested
+    std::vector<double>                    m_bounds;
+
+    LipschitzMode                          m_lipschitzMode;
+    EnclosureFunction                      m_derivative;
+    double                                 m_lipschitzBound;
+
+    std::shared_ptr<EvaluationCache>       m_cache;
+
+    std::function<double(double)>          m_coarse;
+    double                                 m_confirmTolerance;
+    // Coarse value per trial, NaN for trials evaluated with f
+    std::vector<double>                    m_coarseZ;
+    std::vector<double>                    m_batchCoarse;
+    // f - coarse at the confirmed points, ordered by x
+    std::vector<std::pair<double, double>> m_bias;
+    uint32_t                               m_fineCount;
+
+    BoundedFunction                        m_boundedFunction;
+    // 1 where z is only a lower bound of f
+    std::vector<char>                      m_bounded;
+    std::vector<double>                    m_batchCutoff;
+    std::vector<char>                      m_batchBounded;
+    uint32_t                               m_boundedCount;
 };
 
 class SeqScanMethod final : public IMethod
@@ -47,11 +202,13 @@ public:
 
     ~SeqScanMethod() = default;
 private:
-    [[nodiscard]] double getValue(double x1, double x2) override;
+    [[nodiscard]] double getValue(double x1, double z1, double x2, double z2) override;
 
-    [[nodiscard]] double getPoint(double x1, double x2) override;
+    [[nodiscard]] double getPoint(double x1, double z1, double x2, double z2) override;
 
     void preprocess() override;
+
+    void reset() override;
 };
 
 class PiyavskiyMethod final : public IMethod
@@ -63,14 +220,24 @@ public:
                            std::function<double(double)> function);
 
     ~PiyavskiyMethod() = default;
+
+    [[nodiscard]] Trial getModelMinimum(const Trial &left, const Trial &right, double m) const override;
+
 private:
-    [[nodiscard]] double getValue(double x1, double x2) override;
+    [[nodiscard]] double getValue(double x1, double z1, double x2, double z2) override;
 
-    [[nodiscard]] double getPoint(double x1, double x2) override;
+    [[nodiscard]] double getPoint(double x1, double z1, double x2, double z2) override;
 
     void preprocess() override;
 
+    void reset() override;
+
+    [[nodiscard]] double getBound(double x1, double z1, double x2, double z2) override;
+
+    [[nodiscard]] double getLipschitz() const override;
+
     double m_parameter;
+    double m_lipschitz;
     double m;
 };
 
@@ -83,13 +250,23 @@ public:
                            std::function<double(double)> function);
 
     ~StronginMethod() = default;
+
+    [[nodiscard]] Trial getModelMinimum(const Trial &left, const Trial &right, double m) const override;
+
 private:
-    [[nodiscard]] double getValue(double x1, double x2) override;
+    [[nodiscard]] double getValue(double x1, double z1, double x2, double z2) override;
 
-    [[nodiscard]] double getPoint(double x1, double x2) override;
+    [[nodiscard]] double getPoint(double x1, double z1, double x2, double z2) override;
 
     void preprocess() override;
 
+    void reset() override;
+
+    [[nodiscard]] double getBound(double x1, double z1, double x2, double z2) override;
+
+    [[nodiscard]] double getLipschitz() const override;
+
     double m_parameter;
+    double m_lipschitz;
     double m;
 };
\ No newline at end of file
@@ -0,0 +1,281 @@
+// Copyright Lebedev Alexander 2020
+#include "native.hpp"
+#include "storage.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SPPR_DLOPEN 1
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    using Opcode = Expression::Opcode;
+
+    // Contraction into FMA is off so results match the interpreter bit for bit
+    const char *flags = "-std=c++17 -O3 -fno-math-errno -ffp-contract=off -fPIC -shared";
+
+    std::string literal(double value)
+    {
+        // Hexadecimal floats are exact
+        char buffer[64];
+        std::snprintf(buffer, sizeof(buffer), "%a", value);
+        return buffer;
+    }
+
+    uint64_t hash(const std::string &text)
+    {
+        // FNV-1a
+        uint64_t value = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            value = (value ^ c) * 1099511628211ull;
+        }
+        return value;
+    }
+
+    const char *function(Opcode op)
+    {
+        switch (op)
+        {
+        case Opcode::Pow:  return "std::pow";
+        case Opcode::Abs:  return "std::fabs";
+        case Opcode::Sqrt: return "std::sqrt";
+        case Opcode::Exp:  return "std::exp";
+        case Opcode::Log:  return "std::log";
+        case Opcode::Sin:  return "std::sin";
+        case Opcode::Cos:  return "std::cos";
+        case Opcode::Tan:  return "std::tan";
+        case Opcode::Asin: return "std::asin";
+        case Opcode::Acos: return "std::acos";
+        case Opcode::Atan: return "std::atan";
+        case Opcode::Sinh: return "std::sinh";
+        case Opcode::Cosh: return "std::cosh";
+        case Opcode::Tanh: return "std::tanh";
+        default:           return "";
+        }
+    }
+}
+
+NativeExpression::NativeExpression(const Expression &expression,
+                                   const std::string &cacheDirectory,
+                                   const std::string &compiler)
+        : m_expression(expression),
+          m_library(nullptr),
+          m_scalar(nullptr),
+          m_array(nullptr)
+{
+    if (!m_expression.isValid())
+    {
+        m_error = m_expression.getError();
+        return;
+    }
+    load(cacheDirectory, compiler);
+}
+
+NativeExpression::~NativeExpression()
+{
+#ifdef SPPR_DLOPEN
+    if (m_library)
+    {
+        dlclose(m_library);
+    }
+#endif
+}
+
+bool NativeExpression::isCompiled() const noexcept
+{
+    return m_scalar != nullptr;
+}
+
+const std::string &NativeExpression::getError() const noexcept
+{
+    return m_error;
+}
+
+std::string NativeExpression::generate(const Expression &expression)
+{
+    // Every instruction becomes a fresh local, the compiler allocates registers
+    std::vector<std::string> names(expression.getRegisterCount());
+    const auto &constants = expression.getConstants();
+    for (size_t i = 0; i < constants.size(); i++)
+    {
+        names[i] = literal(constants[i]);
+    }
+    names[expression.getVariableRegister()] = "x";
+
+    std::ostringstream body;
+    size_t temporaries = 0;
+    auto define = [&body, &temporaries, &names] (uint32_t dst, const std::string &value) {
+        auto name = "t" + std::to_string(temporaries++);
+        body << "    const double " << name << " = " << value << ";\n";
+        names[dst] = name;
+    };
+
+    for (const auto &instruction : expression.getCode())
+    {
+        const auto &a = names[instruction.lhs];
+        const auto &b = names[instruction.rhs];
+        switch (instruction.op)
+        {
+        case Opcode::Add: define(instruction.dst, a + " + " + b); break;
+        case Opcode::Sub: define(instruction.dst, a + " - " + b); break;
+        case Opcode::Mul: define(instruction.dst, a + " * " + b); break;
+        case Opcode::Div: define(instruction.dst, a + " / " + b); break;
+        case Opcode::Pow: define(instruction.dst, "std::pow(" + a + ", " + b + ")"); break;
+        // The same operand order as std::min and std::max
+        case Opcode::Min: define(instruction.dst, b + " < " + a + " ? " + b + " : " + a); break;
+        case Opcode::Max: define(instruction.dst, a + " < " + b + " ? " + b + " : " + a); break;
+        case Opcode::Neg: define(instruction.dst, "-" + a); break;
+        case Opcode::SinCos:
+        {
+            // Read before either name is replaced, the sine may reuse the argument register
+            auto argument = a;
+            define(instruction.dst, "std::sin(" + argument + ")");
+            define(instruction.rhs, "std::cos(" + argument + ")");
+            break;
+        }
+        case Opcode::Const:
+        case Opcode::Var:
+            break;
+        default:
+            define(instruction.dst, std::string(function(instruction.op)) + "(" + a + ")");
+            break;
+        }
+    }
+
+    std::ostringstream source;
+    source << "#include <cmath>\n"
+           << "#include <cstddef>\n\n"
+           << "static inline double evaluate(double x)\n{\n"
+           << body.str()
+           << "    return " << names[expression.getResultRegister()] << ";\n}\n\n"
+           << "extern \"C\" double sppr_evaluate(double x)\n{\n    return evaluate(x);\n}\n\n"
+           << "extern \"C\" void sppr_evaluate_array(const double *x, double *z, std::size_t count)\n{\n"
+           << "    for (std::size_t i = 0; i < count; i++)\n    {\n        z[i] = evaluate(x[i]);\n    }\n}\n";
+    return source.str();
+}
+
+void NativeExpression::load(const std::string &cacheDirectory, const std::string &compiler)
+{
+#ifdef SPPR_DLOPEN
+    namespace fs = std::filesystem;
+
+    std::string command = compiler;
+    if (command.empty())
+    {
+        const char *environment = std::getenv("CXX");
+        command = environment && *environment ? environment : "c++";
+    }
+
+    fs::path directory = cacheDirectory.empty() ? getCacheDirectory() : fs::path(cacheDirectory);
+    if (directory.empty())
+    {
+        m_error = "no cache directory, set $SPPR_CACHE";
+        return;
+    }
+    if (!cacheDirectory.empty())
+    {
+        std::error_code error;
+        fs::create_directories(directory, error);
+    }
+
+    // Whatever lies in the directory is loaded, so nobody else may write there
+    if (!isPrivate(directory, &m_error))
+    {
+        return;
+    }
+
+    auto source = generate(m_expression);
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash(command + flags + source)));
+    auto library = directory / (std::string("expression-") + key + ".so");
+
+    std::error_code error;
+    if (!fs::exists(library, error))
+    {
+        // Concurrent builds of the same formula write to their own files and
+        // the last rename wins, a loaded object is never rewritten in place
+        auto unique = std::string(key) + "-" + std::to_string(getpid());
+        auto sourcePath = directory / ("expression-" + unique + ".cpp");
+        auto temporary = directory / ("expression-" + unique + ".so");
+        {
+            std::ofstream file(sourcePath);
+            file << source;
+            if (!file)
+            {
+                m_error = "cannot write " + sourcePath.string();
+                return;
+            }
+        }
+
+        auto build = command + " " + flags + " -o \"" + temporary.string() + "\" \"" + sourcePath.string() +
+                     "\" > /dev/null 2>&1";
+        auto status = std::system(build.c_str());
+        fs::remove(sourcePath, error);
+        if (status != 0 || !fs::exists(temporary, error))
+        {
+            fs::remove(temporary, error);
+            m_error = "'" + command + "' failed to build the expression";
+            return;
+        }
+        fs::permissions(temporary, fs::perms::owner_all, fs::perm_options::replace, error);
+        fs::rename(temporary, library, error);
+        if (error)
+        {
+            fs::remove(temporary, error);
+            m_error = "cannot write " + library.string();
+            return;
+        }
+    }
+
+    if (!isPrivate(library, &m_error))
+    {
+        return;
+    }
+
+    m_library = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!m_library)
+    {
+        m_error = dlerror();
+        return;
+    }
+
+    auto scalar = reinterpret_cast<Scalar>(dlsym(m_library, "sppr_evaluate"));
+    auto array = reinterpret_cast<Array>(dlsym(m_library, "sppr_evaluate_array"));
+    if (!scalar || !array)
+    {
+        m_error = "missing entry points in " + library.string();
+        dlclose(m_library);
+        m_library = nullptr;
+        return;
+    }
+    m_scalar = scalar;
+    m_array = array;
+#else
+    m_error = "shared objects cannot be loaded on this platform";
+#endif
+}
+
+double NativeExpression::evaluate(double x) const
+{
+    return m_scalar ? m_scalar(x) : m_expression.evaluate(x);
+}
+
+void NativeExpression::evaluate(const double *x, double *z, size_t count) const
+{
+    if (m_array)
+    {
+        m_array(x, z, count);
+        return;
+    }
+    m_expression.evaluate(x, z, count);
+}
@@ -0,0 +1,53 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "expression.hpp"
+
+#include <cstddef>
+#include <string>
+
+// Translates an expression to C++, builds it with the installed compiler
+// into a shared object and loads it. Objects are cached on disk by the hash
+// of their source, so a formula is compiled once per machine. Without a
+// compiler or dlopen the bytecode interpreter is used.
+class NativeExpression
+{
+public:
+    // Empty arguments select the per-user cache directory (see storage.hpp)
+    // and $CXX or c++. The directory and the object must belong to the
+    // current user and be writable by nobody else.
+    explicit NativeExpression(const Expression &expression,
+                              const std::string &cacheDirectory = "",
+                              const std::string &compiler = "");
+
+    ~NativeExpression();
+
+    NativeExpression(const NativeExpression &) = delete;
+
+    NativeExpression &operator=(const NativeExpression &) = delete;
+
+    [[nodiscard]] bool isCompiled() const noexcept;
+
+    // Why the interpreter is used, empty when compiled
+    [[nodiscard]] const std::string &getError() const noexcept;
+
+    [[nodiscard]] double evaluate(double x) const;
+
+    void evaluate(const double *x, double *z, size_t count) const;
+
+    double operator()(double x) const { return evaluate(x); }
+
+    // Source of the shared object, also used as the cache key
+    [[nodiscard]] static std::string generate(const Expression &expression);
+
+private:
+    using Scalar = double (*)(double x);
+    using Array  = void (*)(const double *x, double *z, size_t count);
+
+    void load(const std::string &cacheDirectory, const std::string &compiler);
+
+    Expression  m_expression;
+    std::string m_error;
+    void       *m_library;
+    Scalar      m_scalar;
+    Array       m_array;
+};
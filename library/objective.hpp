@@ -0,0 +1,40 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "interval.hpp"
+
+#include <cstddef>
+#include <functional>
+
+// Evaluates an objective at count points at once: z[i] = f(x[i])
+using BatchFunction = std::function<void(const double *x, double *z, size_t count)>;
+
+// Evaluates f(x) but may stop as soon as f(x) is known to be at least cutoff,
+// then returns such a lower bound of f(x) and clears *exact
+using BoundedFunction = std::function<double(double x, double cutoff, bool *exact)>;
+
+// Guaranteed enclosure of the objective values over an interval of x
+using EnclosureFunction = std::function<Interval(const Interval &x)>;
+
+// Scalar and array entry points of the same objective
+struct Objective
+{
+    std::function<double(double)> function;
+    BatchFunction                 batch;
+    EnclosureFunction             enclosure;
+    // Enclosure of the derivative, bounds the Lipschitz constant
+    EnclosureFunction             derivative;
+    // Early abort entry point, optional
+    BoundedFunction               bounded;
+
+    explicit operator bool() const noexcept { return static_cast<bool>(function); }
+};
+
+inline BatchFunction makeBatchFunction(std::function<double(double)> function)
+{
+    return [function] (const double *x, double *z, size_t count) {
+        for (size_t i = 0; i < count; i++)
+        {
+            z[i] = function(x[i]);
+        }
+    };
+}
@@ -0,0 +1,74 @@
+/* Copyright Lebedev Alexander 2020 */
+#pragma once
+
+/*
+ * C ABI for objectives shipped as shared libraries.
+ *
+ * A plugin exports
+ *
+ *     int sppr_objective_init(sppr_objective *objective, const char *arguments);
+ *
+ * The loader zeroes the structure, sets `size` and `abi_version` and passes the
+ * user supplied argument string. The plugin fills the entries it provides, may
+ * leave the optional ones null, and returns 0 on success. Fields are only ever
+ * appended, a plugin must not write past `size` bytes.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPPR_OBJECTIVE_ABI_VERSION 1
+
+#define SPPR_OBJECTIVE_ENTRY "sppr_objective_init"
+
+/* The entry points may be called from several threads at once */
+#define SPPR_OBJECTIVE_THREAD_SAFE 0x1u
+
+typedef struct sppr_objective
+{
+    /* Set by the loader */
+    uint32_t size;
+    uint32_t abi_version;
+
+    /* SPPR_OBJECTIVE_* flags */
+    uint32_t flags;
+
+    /* Optional human readable name */
+    const char *name;
+
+    /* Passed to every call */
+    void *context;
+
+    /* Required: F(x) */
+    double (*evaluate)(void *context, double x);
+
+    /* Optional: z[i] = F(x[i]) for count points */
+    void (*evaluate_batch)(void *context, const double *x, double *z, size_t count);
+
+    /*
+     * Optional: returns F(x) and writes F'(x). Loaded and callable through
+     * PluginObjective::evaluateDerivative, but no method uses it yet: the
+     * Lipschitz bound needs a derivative enclosure, which plugins cannot give.
+     */
+    double (*evaluate_derivative)(void *context, double x, double *derivative);
+
+    /* Optional: releases the context when the objective is unloaded */
+    void (*destroy)(void *context);
+
+    /*
+     * Optional: F(x), but may stop once F(x) is known to be at least cutoff,
+     * e.g. when a partial sum of non-negative terms reaches it. Then returns
+     * that lower bound of F(x) and sets *exact to 0, otherwise sets it to 1.
+     */
+    double (*evaluate_bounded)(void *context, double x, double cutoff, int *exact);
+} sppr_objective;
+
+typedef int (*sppr_objective_init_function)(sppr_objective *objective, const char *arguments);
+
+#ifdef __cplusplus
+}
+#endif
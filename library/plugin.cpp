@@ -0,0 +1,211 @@
+// Copyright Lebedev Alexander 2020
+#include "plugin.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SPPR_DLOPEN 1
+#include <dlfcn.h>
+#endif
+
+namespace
+{
+    std::string fingerprint(const std::string &path, const std::string &arguments)
+    {
+        namespace fs = std::filesystem;
+
+        // FNV-1a of the contents, a rebuilt library gets a new fingerprint
+        uint64_t value = 14695981039346656037ull;
+        std::ifstream file(path, std::ios::binary);
+        char buffer[4096];
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+        {
+            for (std::streamsize i = 0; i < file.gcount(); i++)
+            {
+                value = (value ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+            }
+        }
+
+        std::error_code error;
+        auto size = fs::file_size(path, error);
+        auto time = fs::last_write_time(path, error).time_since_epoch().count();
+
+        char key[96];
+        std::snprintf(key, sizeof(key), "%016llx %llu %lld", static_cast<unsigned long long>(value),
+                      static_cast<unsigned long long>(size), static_cast<long long>(time));
+        return "plugin " + path + "\n" + key + "\n" + arguments;
+    }
+
+    // Lock held only for plugins that are not thread safe
+    std::unique_lock<std::mutex> guard(std::mutex &mutex, bool threadSafe)
+    {
+        return threadSafe ? std::unique_lock<std::mutex>() : std::unique_lock<std::mutex>(mutex);
+    }
+}
+
+PluginObjective::PluginObjective(const std::string &path, const std::string &arguments)
+        : m_library(nullptr),
+          m_objective()
+{
+#ifdef SPPR_DLOPEN
+    m_library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!m_library)
+    {
+        m_error = dlerror();
+        return;
+    }
+
+    auto init = reinterpret_cast<sppr_objective_init_function>(dlsym(m_library, SPPR_OBJECTIVE_ENTRY));
+    if (!init)
+    {
+        m_error = path + " does not export " SPPR_OBJECTIVE_ENTRY;
+    } else
+    {
+        std::memset(&m_objective, 0, sizeof(m_objective));
+        m_objective.size = sizeof(m_objective);
+        m_objective.abi_version = SPPR_OBJECTIVE_ABI_VERSION;
+
+        if (init(&m_objective, arguments.c_str()) != 0)
+        {
+            m_error = path + " rejected the arguments '" + arguments + "'";
+        } else if (!m_objective.evaluate)
+        {
+            m_error = path + " provides no evaluate entry point";
+        } else
+        {
+            m_fingerprint = fingerprint(path, arguments);
+        }
+    }
+
+    if (!m_error.empty())
+    {
+        if (m_objective.destroy)
+        {
+            m_objective.destroy(m_objective.context);
+        }
+        m_objective = sppr_objective();
+        dlclose(m_library);
+        m_library = nullptr;
+    }
+#else
+    m_error = "shared objects cannot be loaded on this platform";
+#endif
+}
+
+PluginObjective::~PluginObjective()
+{
+#ifdef SPPR_DLOPEN
+    if (m_library)
+    {
+        if (m_objective.destroy)
+        {
+            m_objective.destroy(m_objective.context);
+        }
+        dlclose(m_library);
+    }
+#endif
+}
+
+bool PluginObjective::isLoaded() const noexcept
+{
+    return m_library != nullptr;
+}
+
+const std::string &PluginObjective::getError() const noexcept
+{
+    return m_error;
+}
+
+std::string PluginObjective::getName() const
+{
+    return m_objective.name ? m_objective.name : "";
+}
+
+const std::string &PluginObjective::getFingerprint() const noexcept
+{
+    return m_fingerprint;
+}
+
+bool PluginObjective::isThreadSafe() const noexcept
+{
+    return (m_objective.flags & SPPR_OBJECTIVE_THREAD_SAFE) != 0;
+}
+
+bool PluginObjective::hasBatch() const noexcept
+{
+    return m_objective.evaluate_batch != nullptr;
+}
+
+bool PluginObjective::hasDerivative() const noexcept
+{
+    return m_objective.evaluate_derivative != nullptr;
+}
+
+bool PluginObjective::hasBounded() const noexcept
+{
+    return m_objective.evaluate_bounded != nullptr;
+}
+
+double PluginObjective::evaluate(double x) const
+{
+    if (!m_objective.evaluate)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    auto lock = guard(m_mutex, isThreadSafe());
+    return m_objective.evaluate(m_objective.context, x);
+}
+
+void PluginObjective::evaluate(const double *x, double *z, size_t count) const
+{
+    if (!m_objective.evaluate)
+    {
+        std::fill(z, z + count, std::numeric_limits<double>::quiet_NaN());
+        return;
+    }
+
+    auto lock = guard(m_mutex, isThreadSafe());
+    if (m_objective.evaluate_batch)
+    {
+        m_objective.evaluate_batch(m_objective.context, x, z, count);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        z[i] = m_objective.evaluate(m_objective.context, x[i]);
+    }
+}
+
+double PluginObjective::evaluateDerivative(double x, double *derivative) const
+{
+    if (!m_objective.evaluate_derivative)
+    {
+        *derivative = std::numeric_limits<double>::quiet_NaN();
+        return evaluate(x);
+    }
+
+    auto lock = guard(m_mutex, isThreadSafe());
+    return m_objective.evaluate_derivative(m_objective.context, x, derivative);
+}
+
+double PluginObjective::evaluateBounded(double x, double cutoff, bool *exact) const
+{
+    if (!m_objective.evaluate_bounded)
+    {
+        *exact = true;
+        return evaluate(x);
+    }
+
+    auto lock = guard(m_mutex, isThreadSafe());
+    int complete = 1;
+    double z = m_objective.evaluate_bounded(m_objective.context, x, cutoff, &complete);
+    *exact = complete != 0;
+    return z;
+}
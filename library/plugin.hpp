@@ -0,0 +1,78 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "objective.hpp"
+#include "objective_plugin.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Objective loaded from a shared library implementing objective_plugin.h.
+// Calls into plugins without SPPR_OBJECTIVE_THREAD_SAFE are serialized.
+class PluginObjective
+{
+public:
+    PluginObjective(const std::string &path, const std::string &arguments = "");
+
+    ~PluginObjective();
+
+    PluginObjective(const PluginObjective &) = delete;
+
+    PluginObjective &operator=(const PluginObjective &) = delete;
+
+    [[nodiscard]] bool isLoaded() const noexcept;
+
+    [[nodiscard]] const std::string &getError() const noexcept;
+
+    [[nodiscard]] std::string getName() const;
+
+    // Identifies the objective across runs: the hash of the library contents,
+    // its size and modification time, and the arguments
+    [[nodiscard]] const std::string &getFingerprint() const noexcept;
+
+    [[nodiscard]] bool isThreadSafe() const noexcept;
+
+    [[nodiscard]] bool hasBatch() const noexcept;
+
+    [[nodiscard]] bool hasDerivative() const noexcept;
+
+    [[nodiscard]] bool hasBounded() const noexcept;
+
+    [[nodiscard]] double evaluate(double x) const;
+
+    // Falls back to scalar calls when the plugin has no batch entry point
+    void evaluate(const double *x, double *z, size_t count) const;
+
+    // NaN derivative when the plugin does not provide one
+    [[nodiscard]] double evaluateDerivative(double x, double *derivative) const;
+
+    // Exact evaluation when the plugin cannot stop early
+    [[nodiscard]] double evaluateBounded(double x, double cutoff, bool *exact) const;
+
+private:
+    void                  *m_library;
+    sppr_objective         m_objective;
+    std::string            m_error;
+    std::string            m_fingerprint;
+    mutable std::mutex     m_mutex;
+};
+
+// The objective keeps the plugin loaded while any copy of it is alive
+inline Objective makeObjective(std::shared_ptr<const PluginObjective> plugin)
+{
+    Objective objective;
+    objective.function = [plugin] (double x) {
+        return plugin->evaluate(x);
+    };
+    objective.batch = [plugin] (const double *x, double *z, size_t count) {
+        plugin->evaluate(x, z, count);
+    };
+    if (plugin->hasBounded())
+    {
+        objective.bounded = [plugin] (double x, double cutoff, bool *exact) {
+            return plugin->evaluateBounded(x, cutoff, exact);
+        };
+    }
+    return objective;
+}
@@ -0,0 +1,51 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "trials.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+struct Progress
+{
+    uint32_t iteration;
+    double   min;
+    double   point;
+    double   m;
+    size_t   intervals;
+};
+
+class IObserver
+{
+public:
+    virtual ~IObserver() = default;
+
+    virtual void onProgress(const Progress &progress) = 0;
+
+    // Called from the search thread for every new trial.
+    virtual void onTrial(const Trial &trial) { }
+};
+
+class CancellationToken
+{
+public:
+    CancellationToken() : m_cancelled(false) { }
+
+    void cancel() noexcept
+    {
+        m_cancelled.store(true, std::memory_order_relaxed);
+    }
+
+    void reset() noexcept
+    {
+        m_cancelled.store(false, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] bool isCancelled() const noexcept
+    {
+        return m_cancelled.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> m_cancelled;
+};
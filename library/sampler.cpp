@@ -0,0 +1,149 @@
+// Copyright Lebedev Alexander 2020
+#include "sampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+    // Coarse grid every curve starts from, so narrow peaks are not skipped
+    constexpr size_t initialPoints = 64;
+
+    // Batches smaller than this are not worth a thread hand-off
+    constexpr size_t parallelThreshold = 256;
+}
+
+CurveSampler::CurveSampler(std::function<double(double)> function,
+                           uint32_t threads)
+        : CurveSampler(makeBatchFunction(function), threads)
+{
+    // Empty constructor
+}
+
+CurveSampler::CurveSampler(BatchFunction function,
+                           uint32_t threads)
+        : m_function(function),
+          m_threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+{
+    // Empty constructor
+}
+
+void CurveSampler::evaluate(const std::vector<double> &x, std::vector<double> &z) const
+{
+    z.resize(x.size());
+
+    if (m_threads < 2 || x.size() < parallelThreshold)
+    {
+        m_function(x.data(), z.data(), x.size());
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    size_t chunk = (x.size() + m_threads - 1) / m_threads;
+
+    for (size_t begin = 0; begin < x.size(); begin += chunk)
+    {
+        size_t end = std::min(x.size(), begin + chunk);
+        workers.emplace_back([this, &x, &z, begin, end] {
+            m_function(x.data() + begin, z.data() + begin, end - begin);
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+std::vector<Trial> CurveSampler::sample(double x1,
+                                        double x2,
+                                        double xTolerance,
+                                        double yTolerance,
+                                        const TrialView *cache) const
+{
+    std::vector<double> x(initialPoints + 1);
+    std::vector<double> z;
+
+    for (size_t i = 0; i <= initialPoints; i++)
+    {
+        x[i] = x1 + (x2 - x1) * static_cast<double>(i) / initialPoints;
+    }
+    evaluate(x, z);
+
+    std::vector<Trial> curve(x.size());
+    for (size_t i = 0; i < x.size(); i++)
+    {
+        curve[i] = {x[i], z[i]};
+    }
+
+    if (cache)
+    {
+        auto first = std::lower_bound(cache->x(), cache->x() + cache->size(), x1);
+        auto last = std::upper_bound(first, cache->x() + cache->size(), x2);
+
+        for (auto it = first; it != last; ++it)
+        {
+            curve.push_back((*cache)[it - cache->x()]);
+        }
+
+        std::sort(curve.begin(), curve.end(), [] (const Trial &lhs, const Trial &rhs) {
+            return lhs.x < rhs.x;
+        });
+
+        curve.erase(std::unique(curve.begin(), curve.end(), [] (const Trial &lhs, const Trial &rhs) {
+            return lhs.x == rhs.x;
+        }), curve.end());
+    }
+
+    // Intervals still to be checked, given by the index of their left end
+    std::vector<size_t> pending(curve.size() - 1);
+    for (size_t i = 0; i < pending.size(); i++)
+    {
+        pending[i] = i;
+    }
+
+    while (!pending.empty())
+    {
+        x.clear();
+        std::vector<size_t> candidates;
+        for (auto i : pending)
+        {
+            if (curve[i + 1].x - curve[i].x > xTolerance)
+            {
+                candidates.push_back(i);
+                x.push_back(0.5 * (curve[i].x + curve[i + 1].x));
+            }
+        }
+        evaluate(x, z);
+
+        std::vector<Trial> refined;
+        std::vector<size_t> next;
+        refined.reserve(curve.size() + candidates.size());
+
+        size_t candidate = 0;
+        for (size_t i = 0; i < curve.size(); i++)
+        {
+            refined.push_back(curve[i]);
+
+            if (candidate < candidates.size() && candidates[candidate] == i)
+            {
+                double linear = 0.5 * (curve[i].z + curve[i + 1].z);
+                double value = z[candidate];
+
+                if (std::fabs(value - linear) > yTolerance || !std::isfinite(value))
+                {
+                    next.push_back(refined.size() - 1);
+                    next.push_back(refined.size());
+                }
+                refined.push_back({x[candidate], value});
+                candidate++;
+            }
+        }
+
+        curve.swap(refined);
+        pending.swap(next);
+    }
+
+    return curve;
+}
@@ -0,0 +1,35 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "objective.hpp"
+#include "trials.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Samples a curve for drawing, refining only intervals where the midpoint
+// deviates from linear interpolation by more than the value tolerance.
+// The function is called concurrently and must be thread safe.
+class CurveSampler
+{
+public:
+    explicit CurveSampler(std::function<double(double)> function,
+                          uint32_t threads = 0);
+
+    // Each thread hands its whole share of a refinement round to the batch function
+    explicit CurveSampler(BatchFunction function,
+                          uint32_t threads = 0);
+
+    // Known trials inside [x1, x2] are used as free samples.
+    [[nodiscard]] std::vector<Trial> sample(double x1,
+                                            double x2,
+                                            double xTolerance,
+                                            double yTolerance,
+                                            const TrialView *cache = nullptr) const;
+
+private:
+    void evaluate(const std::vector<double> &x, std::vector<double> &z) const;
+
+    BatchFunction m_function;
+    uint32_t      m_threads;
+};
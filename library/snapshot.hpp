@@ -0,0 +1,70 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+struct SearchState
+{
+    uint32_t iteration;
+    double   min;
+    double   point;
+    double   m;
+};
+
+// Single writer seqlock: the search thread publishes, any thread may load.
+// Readers never block the writer and retry only while a publish is in flight.
+class StatePublisher
+{
+public:
+    StatePublisher()
+            : m_sequence(0),
+              m_iteration(0),
+              m_min(0.),
+              m_point(0.),
+              m_m(0.)
+    {
+        // Empty constructor
+    }
+
+    void publish(const SearchState &state) noexcept
+    {
+        auto sequence = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_iteration.store(state.iteration, std::memory_order_relaxed);
+        m_min.store(state.min, std::memory_order_relaxed);
+        m_point.store(state.point, std::memory_order_relaxed);
+        m_m.store(state.m, std::memory_order_relaxed);
+
+        m_sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    [[nodiscard]] SearchState load() const noexcept
+    {
+        SearchState state;
+        uint32_t before;
+        uint32_t after;
+        do
+        {
+            before = m_sequence.load(std::memory_order_acquire);
+
+            state.iteration = m_iteration.load(std::memory_order_relaxed);
+            state.min = m_min.load(std::memory_order_relaxed);
+            state.point = m_point.load(std::memory_order_relaxed);
+            state.m = m_m.load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = m_sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        return state;
+    }
+
+private:
+    std::atomic<uint32_t> m_sequence;
+    std::atomic<uint32_t> m_iteration;
+    std::atomic<double>   m_min;
+    std::atomic<double>   m_point;
+    std::atomic<double>   m_m;
+};
@@ -0,0 +1,78 @@
+// Copyright Lebedev Alexander 2020
+#include "storage.hpp"
+
+#include <cstdlib>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SPPR_POSIX 1
+#include <pwd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::filesystem::path getCacheDirectory()
+{
+    namespace fs = std::filesystem;
+
+    const char *environment = std::getenv("SPPR_CACHE");
+    fs::path directory;
+    if (environment && *environment)
+    {
+        directory = environment;
+    } else if ((environment = std::getenv("XDG_CACHE_HOME")) && *environment)
+    {
+        directory = fs::path(environment) / "sppr";
+    } else
+    {
+        const char *home = std::getenv("HOME");
+#ifdef SPPR_POSIX
+        if (!home || !*home)
+        {
+            const auto *user = getpwuid(getuid());
+            home = user ? user->pw_dir : nullptr;
+        }
+#endif
+        if (!home || !*home)
+        {
+            return {};
+        }
+        directory = fs::path(home) / ".cache" / "sppr";
+    }
+
+    std::error_code error;
+    fs::create_directories(directory.parent_path(), error);
+#ifdef SPPR_POSIX
+    mkdir(directory.c_str(), 0700);
+#else
+    fs::create_directory(directory, error);
+#endif
+    return directory;
+}
+
+bool isPrivate(const std::filesystem::path &path, std::string *error)
+{
+#ifdef SPPR_POSIX
+    struct stat status {};
+    if (lstat(path.c_str(), &status) != 0)
+    {
+        *error = "cannot stat " + path.string();
+        return false;
+    }
+    if (S_ISLNK(status.st_mode))
+    {
+        *error = path.string() + " is a symbolic link";
+        return false;
+    }
+    if (status.st_uid != geteuid())
+    {
+        *error = path.string() + " belongs to another user";
+        return false;
+    }
+    if (status.st_mode & (S_IWGRP | S_IWOTH))
+    {
+        *error = path.string() + " is writable by other users";
+        return false;
+    }
+#endif
+    return true;
+}
@@ -0,0 +1,15 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include <filesystem>
+#include <string>
+
+// Directory for the files sppr caches across runs: $SPPR_CACHE, else
+// $XDG_CACHE_HOME/sppr, else ~/.cache/sppr. A missing directory is created
+// accessible to the current user only. Empty when none can be determined.
+std::filesystem::path getCacheDirectory();
+
+// Whether the path belongs to the current user, is not a symbolic link and
+// cannot be written by group or others. Files loaded or mapped from a cache
+// directory are checked, together with the directory, so no other user can
+// plant them.
+bool isPrivate(const std::filesystem::path &path, std::string *error);
@@ -0,0 +1,87 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include <cstddef>
+#include <iterator>
+
+struct Trial
+{
+    double x;
+    double z;
+};
+
+// Read-only view over the trials of a method, sorted by x.
+// It points into the method storage and is invalidated by the next execute().
+class TrialView
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type        = Trial;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = void;
+        using reference         = Trial;
+
+        iterator(const double *x, const double *z) : m_x(x), m_z(z) { }
+
+        Trial operator*() const { return {*m_x, *m_z}; }
+
+        Trial operator[](difference_type n) const { return {m_x[n], m_z[n]}; }
+
+        iterator &operator++() { ++m_x; ++m_z; return *this; }
+
+        iterator operator++(int) { auto copy = *this; ++*this; return copy; }
+
+        iterator &operator--() { --m_x; --m_z; return *this; }
+
+        iterator operator--(int) { auto copy = *this; --*this; return copy; }
+
+        iterator &operator+=(difference_type n) { m_x += n; m_z += n; return *this; }
+
+        iterator &operator-=(difference_type n) { m_x -= n; m_z -= n; return *this; }
+
+        iterator operator+(difference_type n) const { return {m_x + n, m_z + n}; }
+
+        iterator operator-(difference_type n) const { return {m_x - n, m_z - n}; }
+
+        difference_type operator-(const iterator &other) const { return m_x - other.m_x; }
+
+        bool operator==(const iterator &other) const { return m_x == other.m_x; }
+
+        bool operator!=(const iterator &other) const { return m_x != other.m_x; }
+
+        bool operator<(const iterator &other) const { return m_x < other.m_x; }
+
+    private:
+        const double *m_x;
+        const double *m_z;
+    };
+
+    TrialView(const double *x, const double *z, size_t size)
+            : m_x(x),
+              m_z(z),
+              m_size(size)
+    {
+        // Empty constructor
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return m_size; }
+
+    [[nodiscard]] bool empty() const noexcept { return m_size == 0; }
+
+    [[nodiscard]] const double *x() const noexcept { return m_x; }
+
+    [[nodiscard]] const double *z() const noexcept { return m_z; }
+
+    Trial operator[](size_t i) const { return {m_x[i], m_z[i]}; }
+
+    [[nodiscard]] iterator begin() const { return {m_x, m_z}; }
+
+    [[nodiscard]] iterator end() const { return {m_x + m_size, m_z + m_size}; }
+
+private:
+    const double *m_x;
+    const double *m_z;
+    size_t        m_size;
+};
@@ -0,0 +1,587 @@
+// Copyright Lebedev Alexander 2020
+#include "workers.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <new>
+#include <thread>
+
+#if defined(__linux__)
+#define SPPR_WORKERS 1
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Points per request, larger batches are split into several
+    const uint32_t capacity = 1024;
+
+    // Crashes at the same point before it is given up on
+    const uint32_t attempts = 3;
+
+#ifdef SPPR_WORKERS
+    bool notify(int fd)
+    {
+        uint64_t one = 1;
+        while (write(fd, &one, sizeof(one)) < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool wait(int fd)
+    {
+        uint64_t value;
+        while (read(fd, &value, sizeof(value)) < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void closeAll(std::initializer_list<int> fds)
+    {
+        for (auto fd : fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    // A worker request to the helper: its index and request, response and lifeline fds
+    bool sendWorker(int socket, uint32_t index, const int (&fds)[3])
+    {
+        char control[CMSG_SPACE(sizeof(fds))] = {};
+        iovec data = {&index, sizeof(index)};
+        msghdr message = {};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        auto *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+        while (sendmsg(socket, &message, MSG_NOSIGNAL) < 0)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool receiveWorker(int socket, uint32_t *index, int (&fds)[3])
+    {
+        char control[CMSG_SPACE(sizeof(fds))] = {};
+        iovec data = {index, sizeof(*index)};
+        msghdr message = {};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t size;
+        while ((size = recvmsg(socket, &message, 0)) < 0 && errno == EINTR)
+        {
+            // Retry
+        }
+
+        auto *header = CMSG_FIRSTHDR(&message);
+        if (size != sizeof(*index) || !header || header->cmsg_type != SCM_RIGHTS ||
+            header->cmsg_len != CMSG_LEN(sizeof(fds)))
+        {
+            return false;
+        }
+        std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+        return true;
+    }
+#endif
+}
+
+// Lives in shared memory, z[0, done) is final even if the worker dies
+struct WorkerPool::Channel
+{
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> done;
+    std::atomic<uint32_t> scalar;
+    double                x[capacity];
+    double                z[capacity];
+};
+
+WorkerPool::WorkerPool(std::function<double(double)> function, uint32_t workers, BatchFunction batch)
+        : m_function(std::move(function)),
+          m_batch(std::move(batch)),
+          m_helper(-1),
+          m_socket(-1),
+          m_restarts(0),
+          m_failures(0)
+{
+    if (workers == 0)
+    {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+#ifdef SPPR_WORKERS
+    // Channels are mapped before the helper forks, so every worker inherits them
+    m_workers.resize(workers, Worker{-1, -1, -1, -1, nullptr, false});
+    for (auto &worker : m_workers)
+    {
+        void *memory = mmap(nullptr, sizeof(Channel), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            m_error = std::string("cannot map a channel: ") + std::strerror(errno);
+            break;
+        }
+        worker.channel = new (memory) Channel();
+    }
+
+    int sockets[2] = {-1, -1};
+    if (m_error.empty() && socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) < 0)
+    {
+        m_error = std::string("cannot connect the helper: ") + std::strerror(errno);
+    }
+
+    if (m_error.empty())
+    {
+        auto parent = getpid();
+        m_helper = fork();
+        if (m_helper == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            if (getppid() != parent)
+            {
+                _exit(0);
+            }
+            close(sockets[0]);
+            spawn(sockets[1]);
+            _exit(0);
+        }
+
+        close(sockets[1]);
+        m_socket = sockets[0];
+        if (m_helper < 0)
+        {
+            m_error = std::string("cannot start the helper: ") + std::strerror(errno);
+        }
+    }
+
+    for (size_t i = 0; i < m_workers.size() && m_error.empty(); i++)
+    {
+        if (!start(i))
+        {
+            m_error = std::string("cannot start a worker: ") + std::strerror(errno);
+        }
+    }
+
+    if (!m_error.empty())
+    {
+        for (size_t i = 0; i < m_workers.size(); i++)
+        {
+            stop(i);
+            if (m_workers[i].channel)
+            {
+                munmap(m_workers[i].channel, sizeof(Channel));
+            }
+        }
+        m_workers.clear();
+    }
+#else
+    m_error = "worker processes are not supported on this platform";
+#endif
+}
+
+WorkerPool::~WorkerPool()
+{
+#ifdef SPPR_WORKERS
+    // The helper exits once its socket closes, and the workers with it
+    for (size_t i = 0; i < m_workers.size(); i++)
+    {
+        stop(i);
+    }
+    if (m_socket >= 0)
+    {
+        close(m_socket);
+    }
+    if (m_helper > 0)
+    {
+        while (waitpid(m_helper, nullptr, 0) < 0 && errno == EINTR)
+        {
+            // Retry
+        }
+    }
+    for (const auto &worker : m_workers)
+    {
+        munmap(worker.channel, sizeof(Channel));
+    }
+#endif
+}
+
+bool WorkerPool::isRunning() const noexcept
+{
+    return !m_workers.empty();
+}
+
+const std::string &WorkerPool::getError() const noexcept
+{
+    return m_error;
+}
+
+uint32_t WorkerPool::getWorkerCount() const noexcept
+{
+    return static_cast<uint32_t>(m_workers.size());
+}
+
+uint32_t WorkerPool::getRestarts() const noexcept
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_restarts;
+}
+
+uint32_t WorkerPool::getFailures() const noexcept
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_failures;
+}
+
+double WorkerPool::evaluate(double x) const
+{
+    double z;
+    evaluate(&x, &z, 1);
+    return z;
+}
+
+void WorkerPool::evaluate(const double *x, double *z, size_t count) const
+{
+    struct Task
+    {
+        size_t begin;
+        size_t end;
+        bool   scalar;
+    };
+
+    auto inProcess = [this, x, z] (const Task &task) {
+        if (m_batch && !task.scalar)
+        {
+            m_batch(x + task.begin, z + task.begin, task.end - task.begin);
+            return;
+        }
+        for (size_t i = task.begin; i < task.end; i++)
+        {
+            z[i] = m_function(x[i]);
+        }
+    };
+
+    if (m_workers.empty())
+    {
+        // Without workers the calls must not overlap either
+        std::lock_guard<std::mutex> lock(m_mutex);
+        inProcess({0, count, false});
+        return;
+    }
+
+#ifdef SPPR_WORKERS
+    auto size = std::max<size_t>(1, (count + m_workers.size() - 1) / m_workers.size());
+    size = std::min<size_t>(size, capacity);
+
+    std::deque<Task> pending;
+    for (size_t begin = 0; begin < count; begin += size)
+    {
+        pending.push_back({begin, std::min(count, begin + size), false});
+    }
+
+    // Workers claimed by this call and their tasks, only this call touches them
+    std::vector<std::pair<size_t, Task>> active;
+    std::vector<pollfd> fds;
+    std::map<size_t, uint32_t> crashes;
+
+    auto release = [this] (size_t index) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_workers[index].busy = false;
+        m_available.notify_all();
+    };
+
+    while (!pending.empty() || !active.empty())
+    {
+        bool alive = true;
+        std::vector<std::pair<size_t, Task>> claimed;
+        if (!pending.empty())
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto idle = [this] {
+                return std::any_of(m_workers.begin(), m_workers.end(), [] (const Worker &worker) {
+                    return !worker.busy && worker.pid > 0;
+                });
+            };
+            alive = std::any_of(m_workers.begin(), m_workers.end(), [] (const Worker &worker) {
+                return worker.pid > 0;
+            });
+
+            // Wait for a worker only when there is nothing of our own to wait for
+            if (active.empty() && alive)
+            {
+                m_available.wait(lock, [this, &idle] {
+                    return idle() || std::none_of(m_workers.begin(), m_workers.end(), [] (const Worker &worker) {
+                        return worker.pid > 0;
+                    });
+                });
+                alive = idle();
+            }
+
+            for (size_t i = 0; i < m_workers.size() && !pending.empty(); i++)
+            {
+                if (m_workers[i].busy || m_workers[i].pid <= 0)
+                {
+                    continue;
+                }
+                m_workers[i].busy = true;
+                claimed.emplace_back(i, pending.front());
+                pending.pop_front();
+            }
+        }
+
+        if (!alive && active.empty())
+        {
+            // No worker could be restarted
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto &task : pending)
+            {
+                inProcess(task);
+            }
+            break;
+        }
+
+        for (const auto &[i, task] : claimed)
+        {
+            auto *channel = m_workers[i].channel;
+            std::copy(x + task.begin, x + task.end, channel->x);
+            channel->done.store(0, std::memory_order_relaxed);
+            channel->scalar.store(task.scalar, std::memory_order_relaxed);
+            channel->count.store(static_cast<uint32_t>(task.end - task.begin), std::memory_order_release);
+
+            // A worker that cannot be notified is dead, its lifeline reports it
+            notify(m_workers[i].request);
+            active.emplace_back(i, task);
+        }
+
+        if (active.empty())
+        {
+            continue;
+        }
+
+        fds.clear();
+        for (const auto &[i, task] : active)
+        {
+            fds.push_back({m_workers[i].response, POLLIN, 0});
+            fds.push_back({m_workers[i].lifeline, POLLIN, 0});
+        }
+
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            for (const auto &[i, task] : active)
+            {
+                inProcess(task);
+                release(i);
+            }
+            for (const auto &task : pending)
+            {
+                inProcess(task);
+            }
+            break;
+        }
+
+        std::vector<std::pair<size_t, Task>> running;
+        for (size_t k = 0; k < active.size(); k++)
+        {
+            auto i = active[k].first;
+            const auto &task = active[k].second;
+            const auto *channel = m_workers[i].channel;
+
+            if (fds[2 * k].revents & POLLIN)
+            {
+                wait(m_workers[i].response);
+                std::copy(channel->z, channel->z + (task.end - task.begin), z + task.begin);
+                release(i);
+            } else if (fds[2 * k + 1].revents)
+            {
+                // The worker exited and closed its end of the lifeline
+                size_t done = std::min<size_t>(channel->done.load(std::memory_order_acquire), task.end - task.begin);
+                std::copy(channel->z, channel->z + done, z + task.begin);
+
+                auto lost = task.begin + done;
+                bool failed = lost < task.end && task.scalar && ++crashes[lost] >= attempts;
+                if (failed)
+                {
+                    z[lost++] = std::numeric_limits<double>::quiet_NaN();
+                }
+                if (lost < task.end)
+                {
+                    pending.push_front({lost, task.end, true});
+                }
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_failures += failed ? 1 : 0;
+                stop(i);
+                if (start(i))
+                {
+                    m_restarts++;
+                }
+                m_workers[i].busy = false;
+                m_available.notify_all();
+            } else
+            {
+                running.push_back(active[k]);
+            }
+        }
+        active.swap(running);
+    }
+#endif
+}
+
+bool WorkerPool::start(size_t index) const
+{
+#ifdef SPPR_WORKERS
+    int request = eventfd(0, EFD_CLOEXEC);
+    int response = eventfd(0, EFD_CLOEXEC);
+    int lifeline[2] = {-1, -1};
+    if (request < 0 || response < 0 || pipe2(lifeline, O_CLOEXEC) < 0)
+    {
+        closeAll({request, response, lifeline[0], lifeline[1]});
+        return false;
+    }
+
+    // Only the worker keeps the write end, the parent sees it close when the worker dies
+    int32_t pid = -1;
+    bool sent = sendWorker(m_socket, static_cast<uint32_t>(index), {request, response, lifeline[1]});
+    close(lifeline[1]);
+    if (!sent || recv(m_socket, &pid, sizeof(pid), 0) != sizeof(pid) || pid <= 0)
+    {
+        closeAll({request, response, lifeline[0]});
+        return false;
+    }
+
+    auto &worker = m_workers[index];
+    worker.pid = pid;
+    worker.request = request;
+    worker.response = response;
+    worker.lifeline = lifeline[0];
+    return true;
+#else
+    return false;
+#endif
+}
+
+void WorkerPool::stop(size_t index) const
+{
+#ifdef SPPR_WORKERS
+    // Workers are children of the helper, which reaps them. A crashed one is
+    // gone already, a running one exits with the helper.
+    auto &worker = m_workers[index];
+    closeAll({worker.request, worker.response, worker.lifeline});
+    worker.pid = -1;
+    worker.request = -1;
+    worker.response = -1;
+    worker.lifeline = -1;
+#endif
+}
+
+void WorkerPool::spawn(int socket) const
+{
+#ifdef SPPR_WORKERS
+    // Exited workers are reaped automatically
+    signal(SIGCHLD, SIG_IGN);
+
+    uint32_t index;
+    int fds[3];
+    while (receiveWorker(socket, &index, fds))
+    {
+        int32_t pid = -1;
+        if (index < m_workers.size())
+        {
+            auto helper = getpid();
+            pid = fork();
+            if (pid == 0)
+            {
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                if (getppid() != helper)
+                {
+                    _exit(0);
+                }
+                close(socket);
+                m_workers[index].request = fds[0];
+                m_workers[index].response = fds[1];
+                serve(index);
+                _exit(0);
+            }
+        }
+
+        closeAll({fds[0], fds[1], fds[2]});
+        if (send(socket, &pid, sizeof(pid), MSG_NOSIGNAL) != sizeof(pid))
+        {
+            break;
+        }
+    }
+#endif
+}
+
+void WorkerPool::serve(size_t index) const
+{
+#ifdef SPPR_WORKERS
+    const auto &worker = m_workers[index];
+    auto *channel = worker.channel;
+
+    while (wait(worker.request))
+    {
+        auto count = channel->count.load(std::memory_order_acquire);
+        if (m_batch && !channel->scalar.load(std::memory_order_relaxed))
+        {
+            m_batch(channel->x, channel->z, count);
+            channel->done.store(count, std::memory_order_release);
+        } else
+        {
+            // Progress is published point by point, so a crash loses only the rest
+            for (uint32_t i = 0; i < count; i++)
+            {
+                channel->z[i] = m_function(channel->x[i]);
+                channel->done.store(i + 1, std::memory_order_release);
+            }
+        }
+
+        if (!notify(worker.response))
+        {
+            break;
+        }
+    }
+#endif
+}
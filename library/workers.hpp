@@ -0,0 +1,111 @@
+// Copyright Lebedev Alexander 2020
+#pragma once
+#include "objective.hpp"
+
+#include <cstddef>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Evaluates an objective in forked worker processes, so code that is not
+// thread safe or crashes now and then can use all cores. Every worker owns
+// a shared memory channel for its points and values and a pair of eventfds
+// to signal requests and responses. A worker that dies is restarted and the
+// points it had not finished are issued again; a point that kills its
+// worker three times in a row gets NaN.
+//
+// Workers are forked by a helper process, which the pool forks once in its
+// constructor: create the pool before starting threads, on a thread that
+// outlives it, since the helper exits with that thread. Restarts never fork
+// the calling process, so they are safe while other threads run. Workers
+// exit with the helper.
+// Without fork and eventfd (outside Linux) the objective runs in process.
+class WorkerPool
+{
+public:
+    // Zero workers select one per core. The batch function, when given,
+    // evaluates whole chunks; points issued again after a crash use the
+    // scalar one.
+    explicit WorkerPool(std::function<double(double)> function,
+                        uint32_t workers = 0,
+                        BatchFunction batch = nullptr);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    [[nodiscard]] bool isRunning() const noexcept;
+
+    // Why the objective runs in process, empty when the workers are up
+    [[nodiscard]] const std::string &getError() const noexcept;
+
+    [[nodiscard]] uint32_t getWorkerCount() const noexcept;
+
+    // Workers started again after a crash
+    [[nodiscard]] uint32_t getRestarts() const noexcept;
+
+    // Points given up on and set to NaN
+    [[nodiscard]] uint32_t getFailures() const noexcept;
+
+    [[nodiscard]] double evaluate(double x) const;
+
+    // Splits the points among the idle workers. Concurrent calls share the
+    // workers, so scalar calls from several threads run in parallel.
+    void evaluate(const double *x, double *z, size_t count) const;
+
+    double operator()(double x) const { return evaluate(x); }
+
+private:
+    struct Channel;
+
+    struct Worker
+    {
+        int      pid;
+        int      request;
+        int      response;
+        int      lifeline;
+        Channel *channel;
+        bool     busy;
+    };
+
+    // Has the helper fork a worker, called with the mutex held
+    bool start(size_t index) const;
+
+    void stop(size_t index) const;
+
+    // Loop of the helper process, forks a worker per request
+    void spawn(int socket) const;
+
+    void serve(size_t index) const;
+
+    std::function<double(double)>   m_function;
+    BatchFunction                   m_batch;
+    std::string                     m_error;
+    int                             m_helper;
+    int                             m_socket;
+    mutable std::vector<Worker>     m_workers;
+    mutable uint32_t                m_restarts;
+    mutable uint32_t                m_failures;
+    // Guards the busy flags, the helper socket and the counters
+    mutable std::mutex              m_mutex;
+    mutable std::condition_variable m_available;
+};
+
+// The objective keeps the pool running while any copy of it is alive
+inline Objective makeObjective(std::shared_ptr<const WorkerPool> pool)
+{
+    Objective objective;
+    objective.function = [pool] (double x) {
+        return pool->evaluate(x);
+    };
+    objective.batch = [pool] (const double *x, double *z, size_t count) {
+        pool->evaluate(x, z, count);
+    };
+    return objective;
+}
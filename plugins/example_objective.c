@@ -0,0 +1,82 @@
+/* Copyright Lebedev Alexander 2020 */
+/*
+ * Example objective plugin: a*sin(b*x) + c*cos(d*x), the coefficients are
+ * taken from the argument string "a b c d".
+ */
+#include <objective_plugin.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    double a;
+    double b;
+    double c;
+    double d;
+} coefficients;
+
+static double evaluate(void *context, double x)
+{
+    const coefficients *k = (const coefficients *) context;
+    return k->a * sin(k->b * x) + k->c * cos(k->d * x);
+}
+
+static void evaluate_batch(void *context, const double *x, double *z, size_t count)
+{
+    const coefficients *k = (const coefficients *) context;
+    for (size_t i = 0; i < count; i++)
+    {
+        z[i] = k->a * sin(k->b * x[i]) + k->c * cos(k->d * x[i]);
+    }
+}
+
+static double evaluate_derivative(void *context, double x, double *derivative)
+{
+    const coefficients *k = (const coefficients *) context;
+    *derivative = k->a * k->b * cos(k->b * x) - k->c * k->d * sin(k->d * x);
+    return evaluate(context, x);
+}
+
+static void destroy(void *context)
+{
+    free(context);
+}
+
+#if defined(_WIN32)
+__declspec(dllexport)
+#else
+__attribute__((visibility("default")))
+#endif
+int sppr_objective_init(sppr_objective *objective, const char *arguments)
+{
+    if (objective->abi_version < 1 || objective->size < sizeof(sppr_objective))
+    {
+        return 1;
+    }
+
+    coefficients *k = (coefficients *) malloc(sizeof(coefficients));
+    if (!k)
+    {
+        return 1;
+    }
+    k->a = 2.;
+    k->b = 3.;
+    k->c = 3.;
+    k->d = 5.;
+    if (arguments && *arguments && sscanf(arguments, "%lf %lf %lf %lf", &k->a, &k->b, &k->c, &k->d) != 4)
+    {
+        free(k);
+        return 1;
+    }
+
+    objective->flags = SPPR_OBJECTIVE_THREAD_SAFE;
+    objective->name = "a*sin(b*x) + c*cos(d*x)";
+    objective->context = k;
+    objective->evaluate = evaluate;
+    objective->evaluate_batch = evaluate_batch;
+    objective->evaluate_derivative = evaluate_derivative;
+    objective->destroy = destroy;
+    return 0;
+}
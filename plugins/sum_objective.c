@@ -0,0 +1,78 @@
+/* Copyright Lebedev Alexander 2020 */
+/*
+ * Example objective plugin with early abort: the sum of n non-negative terms
+ * (1 - cos(k*x - k)) / k^2, k = 1..n, with n taken from the argument string
+ * (default 1000). A partial sum is a lower bound of the whole one, so the
+ * bounded entry point stops as soon as it reaches the cutoff.
+ */
+#include <objective_plugin.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static double term(size_t k, double x)
+{
+    return (1. - cos((double) k * x - (double) k)) / ((double) k * (double) k);
+}
+
+static double evaluate_bounded(void *context, double x, double cutoff, int *exact)
+{
+    size_t n = *(const size_t *) context;
+    double sum = 0.;
+    for (size_t k = 1; k <= n; k++)
+    {
+        sum += term(k, x);
+        if (sum >= cutoff && k < n)
+        {
+            *exact = 0;
+            return sum;
+        }
+    }
+    *exact = 1;
+    return sum;
+}
+
+static double evaluate(void *context, double x)
+{
+    int exact;
+    return evaluate_bounded(context, x, INFINITY, &exact);
+}
+
+static void destroy(void *context)
+{
+    free(context);
+}
+
+#if defined(_WIN32)
+__declspec(dllexport)
+#else
+__attribute__((visibility("default")))
+#endif
+int sppr_objective_init(sppr_objective *objective, const char *arguments)
+{
+    if (objective->abi_version < 1 || objective->size < sizeof(sppr_objective))
+    {
+        return 1;
+    }
+
+    size_t *n = (size_t *) malloc(sizeof(size_t));
+    if (!n)
+    {
+        return 1;
+    }
+    *n = 1000;
+    if (arguments && *arguments && (sscanf(arguments, "%zu", n) != 1 || *n == 0))
+    {
+        free(n);
+        return 1;
+    }
+
+    objective->flags = SPPR_OBJECTIVE_THREAD_SAFE;
+    objective->name = "sum of (1 - cos(k*x - k)) / k^2";
+    objective->context = n;
+    objective->evaluate = evaluate;
+    objective->evaluate_bounded = evaluate_bounded;
+    objective->destroy = destroy;
+    return 0;
+}